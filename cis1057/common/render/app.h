@@ -7,7 +7,7 @@
 typedef enum {
     KEY_LEFT, KEY_RIGHT, KEY_UP, KEY_DOWN,
     KEY_SPACE, KEY_SHIFT,
-    KEY_F, KEY_L,
+    KEY_F, KEY_L, KEY_M,
     KEY_ESC,
     KEY_COUNT
 } Key;
@@ -36,4 +36,23 @@ double app_time(void);
 // 6) framebuffer: returns pointer + dimensions (so sim can render into it)
 uint32_t *app_framebuffer(int *out_w, int *out_h);
 
+// 7) sleep: yield the CPU for about this many seconds (frame limiter)
+void app_sleep(double seconds);
+
+// 8) pixels: channel order of both paths below, negotiated with the renderer
+typedef enum { APP_XRGB, APP_XBGR } AppPixels;
+AppPixels app_pixels(void);
+
+// 9) zero-copy frames: APP_FRAMES window textures (enough for a triple
+// buffer) to draw straight into, rows *out_pitch pixels apart. Lock frame
+// k, write every pixel, then unlock and show it. The memory is write-only:
+// it need not hold the last frame, nor stay at the same address, from one
+// lock to the next, so keep anything to be read back elsewhere. NULL
+// unless the renderer locks the texture's own memory (the software one);
+// on accelerated renderers locking buys nothing over an upload, so frames
+// go through app_framebuffer and app_present there.
+#define APP_FRAMES 3
+uint32_t *app_lock_frame(int k, int *out_pitch);
+void app_present_locked(int k);
+
 #endif // APP_H
\ No newline at end of file
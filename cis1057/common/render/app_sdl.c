@@ -13,6 +13,17 @@ static SDL_Texture  *g_tex = NULL;
 static uint32_t *g_fb = NULL;
 static int g_w = 0, g_h = 0;
 
+// Texture format and whether locking it hands out the texture's own pixels
+static Uint32 g_format;
+static AppPixels g_pixels = APP_XRGB;
+static int g_lockable = 0;
+
+// Zero-copy frames, apart from g_tex so app_present never unlocks one.
+// Pixels while locked, else NULL.
+static SDL_Texture *g_frames[APP_FRAMES];
+static uint32_t *g_frame_px[APP_FRAMES];
+static int g_frame_pitch[APP_FRAMES];
+
 // Quit flag set by pump()
 static int g_quit = 0;
 
@@ -34,6 +45,7 @@ static int map_scancode(SDL_Scancode sc) {
 
         case SDL_SCANCODE_F:      return KEY_F;
         case SDL_SCANCODE_L:      return KEY_L;
+        case SDL_SCANCODE_M:      return KEY_M;
 
         case SDL_SCANCODE_ESCAPE: return KEY_ESC;
 
@@ -41,6 +53,40 @@ static int map_scancode(SDL_Scancode sc) {
     }
 }
 
+// The first format in the renderer's list (its preference) that we can
+// write directly: 32-bit, 8 bits per channel, R G B in either order, alpha
+// (if any) on top and ignored
+static Uint32 pick_format(void) {
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(g_ren, &info) == 0) {
+        for (Uint32 k = 0; k < info.num_texture_formats; k++) {
+            Uint32 f = info.texture_formats[k];
+            if (f == SDL_PIXELFORMAT_RGB888 || f == SDL_PIXELFORMAT_ARGB8888 ||
+                f == SDL_PIXELFORMAT_BGR888 || f == SDL_PIXELFORMAT_ABGR8888)
+                return f;
+        }
+    }
+    return SDL_PIXELFORMAT_ARGB8888;
+}
+
+// SDL documents locked texture memory as write-only, and the accelerated
+// renderers (GL, D3D) lock a staging copy that is uploaded on unlock
+// anyway, so drawing into it saves nothing over app_present. The software
+// renderer hands out the texture's own surface, which is shown without a
+// copy; only it takes the locked path.
+static int lock_is_texture(void) {
+    SDL_RendererInfo info;
+    return SDL_GetRendererInfo(g_ren, &info) == 0 && (info.flags & SDL_RENDERER_SOFTWARE);
+}
+
+// A window-sized texture to stream frames into; the top byte is left 0, so
+// blending is off
+static SDL_Texture *new_texture(void) {
+    SDL_Texture *t = SDL_CreateTexture(g_ren, g_format, SDL_TEXTUREACCESS_STREAMING, g_w, g_h);
+    if (t) SDL_SetTextureBlendMode(t, SDL_BLENDMODE_NONE);
+    return t;
+}
+
 int app_init(const char *title, int w, int h) {
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER)) return 0;
 
@@ -55,18 +101,17 @@ int app_init(const char *title, int w, int h) {
     );
     if (!g_win) return 0;
 
-    // Renderer: accelerated is fine; we still upload a texture each frame
+    // Renderer: accelerated, with frames uploaded from g_fb; the locked
+    // path is off there (SDL_RENDER_DRIVER=software takes it instead)
     g_ren = SDL_CreateRenderer(g_win, -1, SDL_RENDERER_ACCELERATED);
     if (!g_ren) return 0;
 
-    // Our framebuffer will be interpreted as 0xAARRGGBB (ARGB8888)
-    g_tex = SDL_CreateTexture(
-        g_ren,
-        SDL_PIXELFORMAT_ARGB8888,
-        SDL_TEXTUREACCESS_STREAMING,
-        w, h
-    );
+    // A format the renderer takes natively, so presenting never converts
+    g_format = pick_format();
+    g_pixels = g_format == SDL_PIXELFORMAT_BGR888 || g_format == SDL_PIXELFORMAT_ABGR8888 ? APP_XBGR : APP_XRGB;
+    g_tex = new_texture();
     if (!g_tex) return 0;
+    g_lockable = lock_is_texture();
 
     g_fb = (uint32_t*)SDL_malloc((size_t)w * (size_t)h * sizeof(uint32_t));
     if (!g_fb) return 0;
@@ -80,13 +125,16 @@ int app_init(const char *title, int w, int h) {
 
 void app_shutdown(void) {
     if (g_fb) { SDL_free(g_fb); g_fb = NULL; }
+    for (int k = 0; k < APP_FRAMES; k++)
+        if (g_frames[k]) { SDL_DestroyTexture(g_frames[k]); g_frames[k] = NULL; }
+    memset(g_frame_px, 0, sizeof(g_frame_px));
     if (g_tex) { SDL_DestroyTexture(g_tex); g_tex = NULL; }
     if (g_ren) { SDL_DestroyRenderer(g_ren); g_ren = NULL; }
     if (g_win) { SDL_DestroyWindow(g_win); g_win = NULL; }
 
     SDL_Quit();
 
-    g_quit = g_w = g_h = 0;
+    g_quit = g_w = g_h = g_lockable = 0;
 }
 
 uint32_t *app_framebuffer(int *out_w, int *out_h) {
@@ -95,6 +143,24 @@ uint32_t *app_framebuffer(int *out_w, int *out_h) {
     return g_fb;
 }
 
+AppPixels app_pixels(void) {
+    return g_pixels;
+}
+
+uint32_t *app_lock_frame(int k, int *out_pitch) {
+    if (!g_lockable || k < 0 || k >= APP_FRAMES) return NULL;
+    if (!g_frame_px[k]) {
+        void *p;
+        int pitch;
+        if (!g_frames[k] && !(g_frames[k] = new_texture())) return NULL;
+        if (SDL_LockTexture(g_frames[k], NULL, &p, &pitch)) return NULL;
+        g_frame_px[k] = p;
+        g_frame_pitch[k] = pitch / (int)sizeof(uint32_t);
+    }
+    if (out_pitch) *out_pitch = g_frame_pitch[k];
+    return g_frame_px[k];
+}
+
 double app_time(void) {
     static uint64_t freq = 0;
     if (!freq) freq = SDL_GetPerformanceFrequency();
@@ -102,6 +168,10 @@ double app_time(void) {
     return (double)t / (double)freq;
 }
 
+void app_sleep(double seconds) {
+    if (seconds > 0.0) SDL_Delay((Uint32)(seconds * 1000.0));
+}
+
 int app_pump(Input *in) {
     if (g_quit) return 0;
 
@@ -134,6 +204,7 @@ int app_pump(Input *in) {
 
     cur_down[KEY_F]     = keys[SDL_SCANCODE_F];
     cur_down[KEY_L]     = keys[SDL_SCANCODE_L];
+    cur_down[KEY_M]     = keys[SDL_SCANCODE_M];
     cur_down[KEY_ESC]   = keys[SDL_SCANCODE_ESCAPE];
 
     // Debounce
@@ -147,11 +218,21 @@ int app_pump(Input *in) {
     return 1;
 }
 
+static void show(SDL_Texture *t) {
+    SDL_RenderClear(g_ren);
+    SDL_RenderCopy(g_ren, t, NULL, NULL);
+    SDL_RenderPresent(g_ren);
+}
+
+void app_present_locked(int k) {
+    if (k < 0 || k >= APP_FRAMES || !g_frame_px[k]) return;
+    SDL_UnlockTexture(g_frames[k]);
+    g_frame_px[k] = NULL;
+    show(g_frames[k]);
+}
+
 void app_present(const uint32_t *fb) {
     // Upload framebuffer into texture
     SDL_UpdateTexture(g_tex, NULL, fb, g_w * (int)sizeof(uint32_t));
-
-    SDL_RenderClear(g_ren);
-    SDL_RenderCopy(g_ren, g_tex, NULL, NULL);
-    SDL_RenderPresent(g_ren);
+    show(g_tex);
 }
@@ -0,0 +1,176 @@
+// bench.c
+// Headless benchmark: runs the simulation without a window and reports
+// per-system cost, render cost and peak memory.
+//   usage: bench [-n particles] [-s steps] [--seed S] [-t threads]
+//                [--systems a,b,c] [--render-every K] [--storage float|compact|check]
+//                [--bins B] [--world WxH] [--render auto|discs|density]
+//                [--fade full|lazy] [--procs P] [--numa] [--json]
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define MAX_SYSTEMS 16
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n particles] [-s steps] [--seed S] [-t threads]\n"
+                    "          [--systems a,b,c] [--render-every K] [--storage float|compact|check]\n"
+                    "          [--bins B] [--world WxH] [--render auto|discs|density]\n"
+                    "          [--fade full|lazy] [--procs P] [--numa] [--json]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int n = 100000, steps = 600, threads = 0, render_every = 1, json = 0, storage = SIM_FLOAT, bins = 1;
+    int world_w = W, world_h = H, render = SIM_RENDER_AUTO, fade = SIM_FADE_FULL, procs = 1, numa = 0;
+    unsigned seed = 1;
+    const char *systems = NULL;
+
+    for (int a = 1; a < argc; a++) {
+        const char *arg = argv[a], *val = a + 1 < argc ? argv[a + 1] : NULL;
+        if (strcmp(arg, "--json") == 0) { json = 1; continue; }
+        if (strcmp(arg, "--numa") == 0) { numa = 1; continue; }
+        if (!val) { usage(argv[0]); return 1; }
+        if      (strcmp(arg, "-n") == 0)             n = atoi(val);
+        else if (strcmp(arg, "-s") == 0)             steps = atoi(val);
+        else if (strcmp(arg, "-t") == 0)             threads = atoi(val);
+        else if (strcmp(arg, "--seed") == 0)         seed = (unsigned)strtoul(val, NULL, 10);
+        else if (strcmp(arg, "--systems") == 0)      systems = val;
+        else if (strcmp(arg, "--render-every") == 0) render_every = atoi(val);
+        else if (strcmp(arg, "--bins") == 0)         bins = atoi(val);
+        else if (strcmp(arg, "--procs") == 0)        procs = atoi(val);
+        else if (strcmp(arg, "--world") == 0) {
+            if (sscanf(val, "%dx%d", &world_w, &world_h) != 2) { usage(argv[0]); return 1; }
+        }
+        else if (strcmp(arg, "--render") == 0) {
+            if      (strcmp(val, "auto") == 0)    render = SIM_RENDER_AUTO;
+            else if (strcmp(val, "discs") == 0)   render = SIM_RENDER_DISCS;
+            else if (strcmp(val, "density") == 0) render = SIM_RENDER_DENSITY;
+            else { usage(argv[0]); return 1; }
+        }
+        else if (strcmp(arg, "--fade") == 0) {
+            if      (strcmp(val, "full") == 0) fade = SIM_FADE_FULL;
+            else if (strcmp(val, "lazy") == 0) fade = SIM_FADE_LAZY;
+            else { usage(argv[0]); return 1; }
+        }
+        else if (strcmp(arg, "--storage") == 0) {
+            if      (strcmp(val, "float") == 0)   storage = SIM_FLOAT;
+            else if (strcmp(val, "compact") == 0) storage = SIM_COMPACT;
+            else if (strcmp(val, "check") == 0)   storage = SIM_COMPACT_CHECK;
+            else { usage(argv[0]); return 1; }
+        }
+        else { usage(argv[0]); return 1; }
+        a++;
+    }
+
+    uint32_t *fb = calloc((size_t)W * H, sizeof(uint32_t));
+    if (!fb) return 1;
+
+    sim_seed(seed);
+    sim_set_threads(threads);
+    sim_set_storage(storage);
+    if (!sim_set_world(world_w, world_h)) {
+        fprintf(stderr, "bad world size %dx%d (or too large for compact storage)\n", world_w, world_h);
+        return 1;
+    }
+    if (!sim_set_procs(procs, numa)) {
+        fprintf(stderr, "cannot split the world %dx%d into %d slabs (float storage only, no tree)\n",
+                world_w, world_h, procs);
+        return 1;
+    }
+    if (!sim_set_bins(bins)) {
+        fprintf(stderr, "bins must be 1..%d, and 1 with compact storage\n", SIM_MAX_BINS);
+        return 1;
+    }
+    if (!sim_set_systems(systems)) {
+        fprintf(stderr, "unknown system in '%s'%s\n", systems ? systems : "",
+                storage != SIM_FLOAT ? " (or one without a compact version)" : "");
+        return 1;
+    }
+    sim_init(n);
+    sim_set_render(render);
+    sim_set_fade(fade);
+
+    // Time only the measured steps, not start-up
+    sim_reset_times();
+    double t_step = 0.0, t_render = 0.0;
+    int frames = 0;
+    for (int s = 0; s < steps; s++) {
+        double t0 = now();
+        sim_step(1.0f / 60.0f);
+        double t1 = now();
+        t_step += t1 - t0;
+        if (render_every > 0 && s % render_every == 0) {
+            sim_render(fb, 1.0f);
+            t_render += now() - t1;
+            frames++;
+        }
+    }
+
+    SysTime times[MAX_SYSTEMS];
+    int nsys = sim_system_times(times, MAX_SYSTEMS);
+    SimStats st;
+    sim_get_stats(&st);
+    CompactError ce;
+    int checked = sim_compact_error(&ce);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    double rss_mb = ru.ru_maxrss / 1024.0;      // Linux reports KiB
+
+    // Per-system costs are CPU time summed over threads, so they can add up
+    // to more than the wall-clock step time
+    double particle_steps = (double)n * steps;
+    double render_ns = frames ? t_render * 1e9 / frames : 0.0;
+
+    if (json) {
+        printf("{\"n\": %d, \"steps\": %d, \"seed\": %u, \"threads\": %d,\n", n, steps, seed, threads);
+        printf(" \"step_ns_per_particle\": %.3f,\n", t_step * 1e9 / particle_steps);
+        printf(" \"systems\": {");
+        for (int k = 0; k < nsys; k++)
+            printf("%s\"%s\": %.3f", k ? ", " : "", times[k].name, times[k].seconds * 1e9 / particle_steps);
+        printf("},\n");
+        printf(" \"render_ns_per_frame\": %.0f, \"frames\": %d,\n", render_ns, frames);
+        printf(" \"reorders\": %ld,\n", st.reorders);
+        printf(" \"procs\": %d, \"dropped\": %ld,\n", st.procs, st.dropped);
+        printf(" \"substeps_per_step\": %.3f, \"bins\": [", (double)st.substeps / steps);
+        for (int b = 0; b < bins; b++) printf("%s%d", b ? ", " : "", st.bin_count[b]);
+        printf("],\n");
+        if (checked)
+            printf(" \"compact_error\": {\"pos_rms\": %.4f, \"pos_max\": %.4f, \"vel_rms\": %.4f, "
+                   "\"vel_max\": %.4f, \"radius_max\": %.4f, \"color_max\": %.0f},\n",
+                   ce.pos_rms, ce.pos_max, ce.vel_rms, ce.vel_max, ce.radius_max, ce.color_max);
+        printf(" \"peak_rss_mb\": %.1f}\n", rss_mb);
+    } else {
+        printf("%d particles, %d steps, seed %u\n", n, steps, seed);
+        printf("  %-12s %10.2f ns/particle-step (wall)\n", "sim_step", t_step * 1e9 / particle_steps);
+        for (int k = 0; k < nsys; k++)
+            printf("  %-12s %10.2f ns/particle-step\n", times[k].name, times[k].seconds * 1e9 / particle_steps);
+        printf("  %-12s %10.3f ms/frame (%d frames, %s)\n", "sim_render", render_ns * 1e-6, frames,
+               sim_render_mode() == SIM_RENDER_DENSITY ? "density" : "discs");
+        printf("  %ld reorders\n", st.reorders);
+        if (st.procs > 1)
+            printf("  %d processes (system times are rank 0's), %ld ghosts / migrants dropped\n",
+                   st.procs, st.dropped);
+        if (bins > 1) {
+            printf("  %.2f sub-steps per step; particles per bin:", (double)st.substeps / steps);
+            for (int b = 0; b < bins; b++) printf(" %d", st.bin_count[b]);
+            printf("\n");
+        }
+        if (checked)
+            printf("  compact vs float: position %.4f px rms (%.4f max), velocity %.4f px/s rms (%.4f max),\n"
+                   "                    radius %.4f px max, colour %.0f/255 max\n",
+                   ce.pos_rms, ce.pos_max, ce.vel_rms, ce.vel_max, ce.radius_max, ce.color_max);
+        printf("  peak RSS %.1f MB\n", rss_mb);
+    }
+
+    free(fb);
+    return 0;
+}
@@ -0,0 +1,71 @@
+// bhcheck.c
+// Accuracy / speed of the Barnes-Hut field against the direct O(N^2) sum.
+//   usage: bhcheck [n] [seed]
+#include "bhtree.h"
+#include "sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 20000;
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+
+    float *x = malloc(n * sizeof(float)), *y = malloc(n * sizeof(float)), *r = malloc(n * sizeof(float));
+    float *ax = malloc(n * sizeof(float)), *ay = malloc(n * sizeof(float));
+    if (!x || !y || !r || !ax || !ay) return 1;
+
+    // Half uniform, half in a dense clump, like a run that has collapsed a little
+    for (int i = 0; i < n; i++) {
+        r[i] = rand() % 101 / 20.0f + 8.0f;
+        if (i & 1) {
+            x[i] = (float)(rand() % W);
+            y[i] = (float)(rand() % H);
+        } else {
+            x[i] = W / 2.0f + (rand() % 401 - 200);
+            y[i] = H / 2.0f + (rand() % 401 - 200);
+        }
+    }
+
+    const float G = 1.0f, eps2 = 13.0f * 13.0f;
+    BHTree t = {0};
+    bh_build(&t, x, y, r, n);
+
+    double t0 = now();
+    for (int i = 0; i < n; i++) bh_accel_direct(&t, n, x[i], y[i], i, G, eps2, &ax[i], &ay[i]);
+    double direct = now() - t0;
+    printf("n = %d, direct: %.1f ms\n", n, direct * 1e3);
+    printf("%6s %10s %10s %10s %10s\n", "theta", "build ms", "eval ms", "speedup", "rms err");
+
+    const float thetas[] = {0.3f, 0.5f, 0.7f, 1.0f};
+    for (int k = 0; k < 4; k++) {
+        t0 = now();
+        bh_build(&t, x, y, r, n);
+        double build = now() - t0;
+
+        // Relative error of the force vector, RMS over all particles
+        double err = 0.0;
+        t0 = now();
+        for (int i = 0; i < n; i++) {
+            float bx, by;
+            bh_accel(&t, x[i], y[i], i, thetas[k], G, eps2, &bx, &by);
+            double ex = bx - ax[i], ey = by - ay[i];
+            double ref = (double)ax[i] * ax[i] + (double)ay[i] * ay[i];
+            if (ref > 0.0) err += (ex * ex + ey * ey) / ref;
+        }
+        double eval = now() - t0;
+        printf("%6.2f %10.2f %10.1f %9.1fx %9.2e\n", thetas[k], build * 1e3, eval * 1e3,
+               direct / (build + eval), sqrt(err / n));
+    }
+
+    bh_free(&t);
+    free(x); free(y); free(r); free(ax); free(ay);
+    return 0;
+}
@@ -0,0 +1,173 @@
+// bhtree.c
+#include "bhtree.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_DEPTH 24            // stops runaway splitting of coincident points
+
+void bh_free(BHTree *t) {
+    free(t->nodes);
+    free(t->order);
+    free(t->mass);
+    memset(t, 0, sizeof(*t));
+}
+
+static int new_nodes(BHTree *t, int count) {
+    if (t->nnodes + count > t->node_cap) {
+        int cap = t->node_cap ? t->node_cap * 2 : 1024;
+        while (cap < t->nnodes + count) cap *= 2;
+        BHNode *nodes = realloc(t->nodes, (size_t)cap * sizeof(BHNode));
+        if (!nodes) return -1;
+        t->nodes = nodes;
+        t->node_cap = cap;
+    }
+    int first = t->nnodes;
+    t->nnodes += count;
+    return first;
+}
+
+// Move order[lo, hi) entries with key < split to the front; returns the boundary
+static int partition(int *order, int lo, int hi, const float *key, float split) {
+    while (lo < hi) {
+        if (key[order[lo]] < split) { lo++; continue; }
+        int tmp = order[lo]; order[lo] = order[--hi]; order[hi] = tmp;
+    }
+    return lo;
+}
+
+// Split node k into quadrants and aggregate mass bottom-up.
+// Nodes are addressed by index because new_nodes may move the array.
+static int build(BHTree *t, int k, int depth) {
+    BHNode n = t->nodes[k];
+
+    if (n.end - n.begin > BH_LEAF && depth < MAX_DEPTH) {
+        int first = new_nodes(t, 4);
+        if (first < 0) return 0;
+
+        // Quadrants ordered (-,-) (+,-) (-,+) (+,+) in (x, y)
+        int ym = partition(t->order, n.begin, n.end, t->y, n.cy);
+        int x0 = partition(t->order, n.begin, ym, t->x, n.cx);
+        int x1 = partition(t->order, ym, n.end, t->x, n.cx);
+        int bounds[5] = {n.begin, x0, ym, x1, n.end};
+
+        float h = n.half * 0.5f;
+        n.child = first;
+        n.mass = n.mx = n.my = 0.0f;
+        for (int q = 0; q < 4; q++) {
+            BHNode *c = &t->nodes[first + q];
+            c->cx = n.cx + (q & 1 ? h : -h);
+            c->cy = n.cy + (q & 2 ? h : -h);
+            c->half = h;
+            c->child = -1;
+            c->begin = bounds[q];
+            c->end = bounds[q + 1];
+            if (!build(t, first + q, depth + 1)) return 0;
+            c = &t->nodes[first + q];
+            n.mass += c->mass;
+            n.mx += c->mass * c->mx;
+            n.my += c->mass * c->my;
+        }
+    } else {
+        n.mass = n.mx = n.my = 0.0f;
+        for (int a = n.begin; a < n.end; a++) {
+            int i = t->order[a];
+            n.mass += t->mass[i];
+            n.mx += t->mass[i] * t->x[i];
+            n.my += t->mass[i] * t->y[i];
+        }
+    }
+
+    if (n.mass > 0.0f) {
+        n.mx /= n.mass;
+        n.my /= n.mass;
+    } else {
+        n.mx = n.cx;
+        n.my = n.cy;
+    }
+    t->nodes[k] = n;
+    return 1;
+}
+
+int bh_build(BHTree *t, const float *x, const float *y, const float *r, int n) {
+    if (n > t->cap) {
+        int *order = realloc(t->order, (size_t)n * sizeof(int));
+        if (!order) return 0;
+        t->order = order;
+        float *mass = realloc(t->mass, (size_t)n * sizeof(float));
+        if (!mass) return 0;
+        t->mass = mass;
+        t->cap = n;
+    }
+    t->x = x;
+    t->y = y;
+    t->nnodes = 0;
+
+    float x0 = 0.0f, x1 = 0.0f, y0 = 0.0f, y1 = 0.0f;
+    for (int i = 0; i < n; i++) {
+        t->order[i] = i;
+        t->mass[i] = r[i] * r[i];
+        if (i == 0 || x[i] < x0) x0 = x[i];
+        if (i == 0 || x[i] > x1) x1 = x[i];
+        if (i == 0 || y[i] < y0) y0 = y[i];
+        if (i == 0 || y[i] > y1) y1 = y[i];
+    }
+
+    int root = new_nodes(t, 1);
+    if (root < 0) return 0;
+    BHNode *b = &t->nodes[root];
+    b->cx = 0.5f * (x0 + x1);
+    b->cy = 0.5f * (y0 + y1);
+    b->half = 0.5f * fmaxf(x1 - x0, y1 - y0) + 1.0f;
+    b->child = -1;
+    b->begin = 0;
+    b->end = n;
+    return build(t, root, 0);
+}
+
+static inline void add_body(float x, float y, float bx, float by, float m, float eps2,
+                            float *ax, float *ay) {
+    float dx = bx - x, dy = by - y;
+    float d2 = dx * dx + dy * dy + eps2;
+    float inv = 1.0f / sqrtf(d2);
+    float s = m * inv * inv * inv;
+    *ax += s * dx;
+    *ay += s * dy;
+}
+
+void bh_accel(const BHTree *t, float x, float y, int skip, float theta, float G, float eps2,
+              float *ax, float *ay) {
+    float sx = 0.0f, sy = 0.0f;
+    float theta2 = theta * theta;
+    int stack[4 * MAX_DEPTH + 4], top = 0;
+
+    if (t->nnodes) stack[top++] = 0;
+    while (top) {
+        const BHNode *n = &t->nodes[stack[--top]];
+        if (n->mass == 0.0f) continue;
+
+        float dx = n->mx - x, dy = n->my - y;
+        float size = 2.0f * n->half;
+        if (size * size < theta2 * (dx * dx + dy * dy)) {
+            add_body(x, y, n->mx, n->my, n->mass, eps2, &sx, &sy);
+        } else if (n->child < 0) {
+            for (int a = n->begin; a < n->end; a++) {
+                int j = t->order[a];
+                if (j != skip) add_body(x, y, t->x[j], t->y[j], t->mass[j], eps2, &sx, &sy);
+            }
+        } else {
+            for (int q = 0; q < 4; q++) stack[top++] = n->child + q;
+        }
+    }
+    *ax = G * sx;
+    *ay = G * sy;
+}
+
+void bh_accel_direct(const BHTree *t, int n, float x, float y, int skip, float G, float eps2,
+                     float *ax, float *ay) {
+    float sx = 0.0f, sy = 0.0f;
+    for (int j = 0; j < n; j++)
+        if (j != skip) add_body(x, y, t->x[j], t->y[j], t->mass[j], eps2, &sx, &sy);
+    *ax = G * sx;
+    *ay = G * sy;
+}
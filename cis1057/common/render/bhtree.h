@@ -0,0 +1,43 @@
+// bhtree.h
+#ifndef BHTREE_H
+#define BHTREE_H
+
+// Barnes-Hut quadtree for long-range forces.
+// Each node stores its total mass and centre of mass; a node that looks
+// small enough from the query point (size / distance < theta) is treated as
+// a single body, otherwise its children are opened. Leaves hold up to
+// BH_LEAF particles that are summed directly.
+#define BH_LEAF 8
+
+typedef struct {
+    float cx, cy, half;     // square bounds: centre and half-width
+    float mass, mx, my;     // total mass and centre of mass
+    int child;              // first of 4 consecutive children, or -1 for a leaf
+    int begin, end;         // particles of this node: order[begin .. end)
+} BHNode;
+
+typedef struct {
+    BHNode *nodes;
+    int nnodes, node_cap;
+    int *order;             // particle indices, grouped by node
+    float *mass;            // per-particle mass (radius squared)
+    int cap;
+    const float *x, *y;     // positions from the last build
+} BHTree;
+
+void bh_free(BHTree *t);
+
+// Rebuild over n particles with mass r^2; returns 0 on allocation failure
+int bh_build(BHTree *t, const float *x, const float *y, const float *r, int n);
+
+// Field at (x, y) from every particle except skip (pass -1 to include all):
+//   a = G * sum m_j * (p_j - p) / (|p_j - p|^2 + eps2)^(3/2)
+// G > 0 attracts, G < 0 repels; eps2 softens close encounters.
+void bh_accel(const BHTree *t, float x, float y, int skip, float theta, float G, float eps2,
+              float *ax, float *ay);
+
+// Same sum evaluated over all n particles directly, for reference
+void bh_accel_direct(const BHTree *t, int n, float x, float y, int skip, float G, float eps2,
+                     float *ax, float *ay);
+
+#endif // BHTREE_H
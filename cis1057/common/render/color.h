@@ -4,13 +4,11 @@ uint32_t rgb(uint8_t r, uint8_t g, uint8_t b) {
     return (uint32_t)r << 16 | (uint32_t)g << 8 | (uint32_t)b;
 }
 
-uint32_t random_color() {
-    return rgb(rand() % 192 + 64, rand() % 192 + 64, rand() % 192 + 64);
+uint32_t swap_rb(uint32_t c) {
+    return (c & 0xFF) << 16 | (c & 0xFF00) | (c >> 16 & 0xFF);
 }
 
-uint32_t fade(uint32_t color, float delta) {
-    uint8_t r = color >> 16;
-    uint8_t g = color >> 8;
-    uint8_t b = color;
-    return rgb(delta * r, delta * g, delta * b);
+// Channels in [64, 256) from three uniform draws in [0, 1)
+uint32_t random_color(float u, float v, float w) {
+    return rgb((uint8_t)(u * 192.0f) + 64, (uint8_t)(v * 192.0f) + 64, (uint8_t)(w * 192.0f) + 64);
 }
\ No newline at end of file
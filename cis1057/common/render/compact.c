@@ -0,0 +1,133 @@
+// compact.c
+#include "compact.h"
+#include <stdlib.h>
+
+#define ALIGN 64
+
+static void *regrow(void *old, int n, int cap, size_t elem) {
+    void *a = aligned_alloc(ALIGN, ((size_t)cap * elem + ALIGN - 1) / ALIGN * ALIGN);
+    if (a && n) memcpy(a, old, (size_t)n * elem);
+    return a;
+}
+
+int compact_reserve(Compact *c, int cap, int n) {
+    if (cap <= c->cap) return 1;
+
+    uint16_t **wide[] = {&c->x, &c->y, &c->px, &c->py, &c->vx, &c->vy, &c->scratch};
+    uint8_t **narrow[] = {&c->r, &c->col};
+    enum {NWIDE = sizeof(wide) / sizeof(wide[0]), NNARROW = sizeof(narrow) / sizeof(narrow[0])};
+    void *a[NWIDE + NNARROW];
+    int ok = 1;
+    for (int k = 0; k < NWIDE; k++) ok &= (a[k] = regrow(*wide[k], n, cap, 2)) != NULL;
+    for (int k = 0; k < NNARROW; k++) ok &= (a[NWIDE + k] = regrow(*narrow[k], n, cap, 1)) != NULL;
+    if (!ok) {
+        for (int k = 0; k < NWIDE + NNARROW; k++) free(a[k]);
+        return 0;
+    }
+
+    for (int k = 0; k < NWIDE; k++) { free(*wide[k]); *wide[k] = a[k]; }
+    for (int k = 0; k < NNARROW; k++) { free(*narrow[k]); *narrow[k] = a[NWIDE + k]; }
+    c->cap = cap;
+    return 1;
+}
+
+void compact_free(Compact *c) {
+    free(c->x); free(c->y); free(c->px); free(c->py);
+    free(c->vx); free(c->vy);
+    free(c->r); free(c->col);
+    free(c->scratch);
+    memset(c, 0, sizeof(*c));
+}
+
+void compact_pack(Compact *c, const Particles *p, int lo, int hi) {
+    float *const *f = p->c;
+    for (int i = lo; i < hi; i++) {
+        c->x[i]   = cpos_pack(f[X][i]);
+        c->y[i]   = cpos_pack(f[Y][i]);
+        c->px[i]  = cpos_pack(f[PX][i]);
+        c->py[i]  = cpos_pack(f[PY][i]);
+        c->vx[i]  = half_pack(f[VX][i]);
+        c->vy[i]  = half_pack(f[VY][i]);
+        c->r[i]   = crad_pack(f[R][i]);
+        c->col[i] = compact_color_index(p->color[i]);
+    }
+}
+
+void compact_unpack(const Compact *c, Particles *p, int lo, int hi) {
+    float *const *f = p->c;
+    for (int i = lo; i < hi; i++) {
+        f[X][i]  = cpos_unpack(c->x[i]);
+        f[Y][i]  = cpos_unpack(c->y[i]);
+        f[PX][i] = cpos_unpack(c->px[i]);
+        f[PY][i] = cpos_unpack(c->py[i]);
+        f[VX][i] = half_unpack(c->vx[i]);
+        f[VY][i] = half_unpack(c->vy[i]);
+        f[R][i]  = crad_unpack(c->r[i]);
+        f[IM][i] = 1.0f / (f[R][i] * f[R][i]);
+        p->color[i] = compact_color(c->col[i]);
+    }
+}
+
+float compact_locality(const Compact *c, int n, float dist) {
+    if (n < 2) return 1.0f;
+    float d2 = dist * dist;
+    int step = n / 4096 + 1, near = 0, total = 0;
+    for (int i = 0; i + 1 < n; i += step) {
+        float dx = cpos_unpack(c->x[i + 1]) - cpos_unpack(c->x[i]);
+        float dy = cpos_unpack(c->y[i + 1]) - cpos_unpack(c->y[i]);
+        near += dx * dx + dy * dy < d2;
+        total++;
+    }
+    return (float)near / (float)total;
+}
+
+void compact_move(Compact *c, int dst, int src) {
+    c->x[dst] = c->x[src];
+    c->y[dst] = c->y[src];
+    c->px[dst] = c->px[src];
+    c->py[dst] = c->py[src];
+    c->vx[dst] = c->vx[src];
+    c->vy[dst] = c->vy[src];
+    c->r[dst] = c->r[src];
+    c->col[dst] = c->col[src];
+}
+
+// 16-bit arrays swap with the scratch buffer like particles_permute does;
+// the byte arrays are gathered into it and copied back
+void compact_permute(Compact *c, const int *perm, int n) {
+    uint16_t **wide[] = {&c->x, &c->y, &c->px, &c->py, &c->vx, &c->vy};
+    for (int k = 0; k < 6; k++) {
+        uint16_t *src = *wide[k], *dst = c->scratch;
+        for (int i = 0; i < n; i++) dst[i] = src[perm[i]];
+        *wide[k] = dst;
+        c->scratch = src;
+    }
+    uint8_t *narrow[] = {c->r, c->col}, *tmp = (uint8_t *)c->scratch;
+    for (int k = 0; k < 2; k++) {
+        for (int i = 0; i < n; i++) tmp[i] = narrow[k][perm[i]];
+        memcpy(narrow[k], tmp, (size_t)n);
+    }
+}
+
+// spawn() draws channels from [64, 256); the palette splits that range into
+// 6 red, 7 green and 6 blue levels and uses the centre of each
+#define PAL_LO 64
+static const int levels[3] = {6, 7, 6};
+
+uint32_t compact_color(uint8_t k) {
+    int l[3] = {k / (levels[1] * levels[2]), k / levels[2] % levels[1], k % levels[2]};
+    uint32_t rgb = 0;
+    for (int ch = 0; ch < 3; ch++)
+        rgb = rgb << 8 | (uint32_t)(PAL_LO + (2 * l[ch] + 1) * (256 - PAL_LO) / (2 * levels[ch]));
+    return rgb;
+}
+
+uint8_t compact_color_index(uint32_t rgb) {
+    int k = 0;
+    for (int ch = 0; ch < 3; ch++) {
+        int v = (int)(rgb >> (16 - 8 * ch) & 0xFF) - PAL_LO;
+        int l = v < 0 ? 0 : v * levels[ch] / (256 - PAL_LO);
+        k = k * levels[ch] + (l < levels[ch] ? l : levels[ch] - 1);
+    }
+    return (uint8_t)k;
+}
@@ -0,0 +1,135 @@
+// compact.h
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "particles.h"
+
+// Reduced-precision copy of the particle state: 14 bytes a particle against
+// 32 for the float table, for runs where memory bandwidth is the limit.
+//   X, Y, PX, PY  uint16 fixed point, 1/CPOS_SCALE px from -CPOS_ORIGIN
+//   VX, VY        IEEE half (about 3 significant digits)
+//   R             uint8, CRAD_LO + q / CRAD_SCALE
+//   colour        uint8 index into a 6x7x6 palette over the spawner's range
+// Kernels unpack in registers, compute in float and round back to nearest.
+#define CPOS_SCALE  16.0f
+#define CPOS_ORIGIN 512.0f       // margin left of / below the world
+#define CPOS_MAX_WORLD (65535.0f / CPOS_SCALE - 2.0f * CPOS_ORIGIN)  // same margin on the far side
+#define CRAD_LO     8.0f
+#define CRAD_SCALE  32.0f
+
+typedef struct {
+    uint16_t *x, *y, *px, *py;
+    uint16_t *vx, *vy;
+    uint8_t *r, *col;
+    uint16_t *scratch;      // permutation buffer
+    int cap;
+} Compact;
+
+// Grow to cap particles keeping the first n; returns 0 on failure
+int compact_reserve(Compact *c, int cap, int n);
+void compact_free(Compact *c);
+
+// Convert particles [lo, hi) between the float table and the compact copy
+void compact_pack(Compact *c, const Particles *p, int lo, int hi);
+void compact_unpack(const Compact *c, Particles *p, int lo, int hi);
+
+// particles_locality over the compact positions
+float compact_locality(const Compact *c, int n, float dist);
+
+// Slot moves mirroring particles_swap_remove / particles_permute
+void compact_move(Compact *c, int dst, int src);
+void compact_permute(Compact *c, const int *perm, int n);
+
+// Palette colour of index k, and the index nearest to an rgb colour
+uint32_t compact_color(uint8_t k);
+uint8_t compact_color_index(uint32_t rgb);
+
+static inline float cpos_unpack(uint16_t q) {
+    return q * (1.0f / CPOS_SCALE) - CPOS_ORIGIN;
+}
+
+static inline uint16_t cpos_pack(float x) {
+    float q = (x + CPOS_ORIGIN) * CPOS_SCALE;
+    q = q > 0.0f ? q : 0.0f;
+    q = q < 65535.0f ? q : 65535.0f;
+    return (uint16_t)nearbyintf(q);
+}
+
+// Integration moves a particle by well under a position step at low speed,
+// so plain rounding would stall slow particles and bias the rest. Adding a
+// per-particle, per-step dither u in [0, 1) before flooring makes the
+// rounding unbiased; the error then grows like sqrt(steps) instead of steps.
+static inline uint32_t dither_hash(uint32_t k) {
+    k ^= k >> 16;
+    k *= 0x7FEB352Du;
+    k ^= k >> 15;
+    k *= 0x846CA68Bu;
+    k ^= k >> 16;
+    return k;
+}
+
+static inline uint16_t cpos_pack_dither(float x, float u) {
+    float q = floorf((x + CPOS_ORIGIN) * CPOS_SCALE + u);
+    q = q > 0.0f ? q : 0.0f;
+    q = q < 65535.0f ? q : 65535.0f;
+    return (uint16_t)q;
+}
+
+static inline float crad_unpack(uint8_t q) {
+    return q * (1.0f / CRAD_SCALE) + CRAD_LO;
+}
+
+static inline uint8_t crad_pack(float r) {
+    float q = (r - CRAD_LO) * CRAD_SCALE;
+    q = q > 0.0f ? q : 0.0f;
+    q = q < 255.0f ? q : 255.0f;
+    return (uint8_t)nearbyintf(q);
+}
+
+// Software half conversions, rounding to nearest even like F16C does
+static inline float half_unpack(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16, e = h >> 10 & 0x1F, m = h & 0x3FF, bits;
+    if (e == 0) {
+        float f = m * (1.0f / 16777216.0f);     // subnormal: m * 2^-24, exact
+        memcpy(&bits, &f, 4);
+        bits |= sign;
+    } else if (e == 31) {
+        bits = sign | 0x7F800000u | m << 13;
+    } else {
+        bits = sign | (e + 112) << 23 | m << 13;
+    }
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+static inline uint16_t half_pack(float f) {
+    uint32_t u;
+    memcpy(&u, &f, 4);
+    uint32_t sign = u >> 16 & 0x8000;
+    u &= 0x7FFFFFFFu;
+    uint16_t h;
+    if (u >= 143u << 23) {                      // >= 65536, inf or nan
+        h = u > 0x7F800000u ? 0x7E00 : 0x7C00;
+    } else if (u < 113u << 23) {                // half subnormal or zero
+        // Adding 0.5 lines the result up with the bottom mantissa bits and
+        // lets the FPU do the rounding
+        const uint32_t magic_bits = 126u << 23;
+        float a, magic;
+        memcpy(&a, &u, 4);
+        memcpy(&magic, &magic_bits, 4);
+        a += magic;
+        memcpy(&u, &a, 4);
+        h = (uint16_t)(u - magic_bits);
+    } else {
+        u += (uint32_t)(15 - 127) << 23;        // rebias the exponent
+        u += 0xFFF + (u >> 13 & 1);             // round to nearest even
+        h = (uint16_t)(u >> 13);
+    }
+    return h | (uint16_t)sign;
+}
+
+#endif // COMPACT_H
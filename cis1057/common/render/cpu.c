@@ -0,0 +1,26 @@
+// cpu.c
+#include "cpu.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *names[] = {"scalar", "sse2", "avx2"};
+
+const char *cpu_level_name(CpuLevel l) {
+    return names[l];
+}
+
+CpuLevel cpu_level(void) {
+    CpuLevel l = CPU_SCALAR;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) l = CPU_SSE2;
+    // The avx2 kernels also use the F16C half conversions (every AVX2 CPU has them)
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) l = CPU_AVX2;
+#endif
+    const char *cap = getenv("SIM_SIMD");
+    if (cap) {
+        for (int k = CPU_SCALAR; k <= CPU_AVX2; k++)
+            if (strcmp(cap, names[k]) == 0 && (CpuLevel)k < l) l = (CpuLevel)k;
+    }
+    return l;
+}
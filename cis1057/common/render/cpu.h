@@ -0,0 +1,13 @@
+// cpu.h
+#ifndef CPU_H
+#define CPU_H
+
+// Instruction-set levels for runtime kernel dispatch, in increasing order
+typedef enum { CPU_SCALAR, CPU_SSE2, CPU_AVX2 } CpuLevel;
+
+// Best level this CPU supports, capped by the SIM_SIMD environment variable
+// ("scalar", "sse2" or "avx2") so the paths can be compared on one machine
+CpuLevel cpu_level(void);
+const char *cpu_level_name(CpuLevel l);
+
+#endif // CPU_H
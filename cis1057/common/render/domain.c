@@ -0,0 +1,210 @@
+// domain.c
+#define _GNU_SOURCE
+#include "domain.h"
+#include <string.h>
+
+#ifdef __linux__
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PAGE 4096
+
+struct DomainShared {
+    pthread_barrier_t barrier;
+    DomainCmd cmd;
+    int count[DOMAIN_MAX];
+    int sent[DOMAIN_MAX][DOMAIN_MAX];   // [src][dst] particles in each mailbox
+};
+
+// Mailboxes follow the header, then the framebuffers
+static size_t head_bytes(void) {
+    return (sizeof(DomainShared) + PAGE - 1) / PAGE * PAGE;
+}
+
+static DomainParticle *mailbox(const Domain *d, int src, int dst) {
+    DomainParticle *m = (DomainParticle *)((char *)d->sh + head_bytes());
+    return m + ((size_t)src * d->nprocs + dst) * d->cap;
+}
+
+// Pin the calling process to the CPUs in /sys/.../node<k>/cpulist, written
+// as ranges like "0-3,8-11"
+static void pin_to_node(int rank) {
+    char path[64];
+    int nodes = 0;
+    for (;; nodes++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", nodes);
+        if (access(path, F_OK) != 0) break;
+    }
+    if (nodes < 2) return;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", rank % nodes);
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    int lo, hi, any = 0;
+    for (char sep = ','; sep == ',' && fscanf(f, "%d", &lo) == 1; ) {
+        hi = lo;
+        if (fscanf(f, "%c", &sep) == 1 && sep == '-' && fscanf(f, "%d%c", &hi, &sep) < 1) break;
+        for (int c = lo; c <= hi && c < CPU_SETSIZE; c++) { CPU_SET(c, &set); any = 1; }
+    }
+    fclose(f);
+    if (any) sched_setaffinity(0, sizeof(set), &set);
+}
+
+int domain_start(Domain *d, int nprocs, float world_w, int cap, int fb_pixels, int numa) {
+    memset(d, 0, sizeof(*d));
+    if (nprocs < 1 || nprocs > DOMAIN_MAX || cap < 1) return 0;
+    size_t mail = (size_t)nprocs * nprocs * cap * sizeof(DomainParticle);
+    size_t bytes = head_bytes() + mail + (size_t)nprocs * fb_pixels * sizeof(uint32_t);
+    // Pages are only backed once touched, so idle mailboxes cost nothing
+    void *m = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (m == MAP_FAILED) return 0;
+
+    d->sh = m;
+    d->bytes = bytes;
+    d->nprocs = nprocs;
+    d->slab = world_w / nprocs;
+    d->cap = cap;
+    d->fb_pixels = fb_pixels;
+
+    pthread_barrierattr_t attr;
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    int ok = pthread_barrier_init(&d->sh->barrier, &attr, (unsigned)nprocs) == 0;
+    pthread_barrierattr_destroy(&attr);
+    if (!ok) {
+        munmap(m, bytes);
+        return 0;
+    }
+
+    // Fork before any threads exist; a rank that loses its parent is killed
+    pid_t parent = getpid();
+    for (int r = 1; r < nprocs; r++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (getppid() != parent) _exit(1);
+            d->rank = r;
+            break;
+        }
+        if (pid < 0) {
+            for (int k = 1; k < r; k++) kill(d->pid[k], SIGKILL);
+            for (int k = 1; k < r; k++) waitpid(d->pid[k], NULL, 0);
+            pthread_barrier_destroy(&d->sh->barrier);
+            munmap(m, bytes);
+            memset(d, 0, sizeof(*d));
+            return 0;
+        }
+        d->pid[r] = pid;
+    }
+    if (numa) pin_to_node(d->rank);
+    return 1;
+}
+
+void domain_stop(Domain *d) {
+    if (!d->sh || d->rank != 0) return;
+    DomainCmd quit = {DOMAIN_QUIT, 0, 0, 0, 0, 0, 0, 0, 0};
+    domain_post_cmd(d, &quit);
+    for (int r = 1; r < d->nprocs; r++) waitpid(d->pid[r], NULL, 0);
+    pthread_barrier_destroy(&d->sh->barrier);
+    munmap(d->sh, d->bytes);
+    memset(d, 0, sizeof(*d));
+}
+
+void domain_sync(Domain *d) {
+    pthread_barrier_wait(&d->sh->barrier);
+}
+
+void domain_post_cmd(Domain *d, const DomainCmd *c) {
+    d->sh->cmd = *c;
+    domain_sync(d);
+}
+
+void domain_wait_cmd(Domain *d, DomainCmd *c) {
+    domain_sync(d);
+    *c = d->sh->cmd;
+}
+
+void domain_clear(Domain *d) {
+    for (int dst = 0; dst < d->nprocs; dst++) d->sh->sent[d->rank][dst] = 0;
+}
+
+int domain_send(Domain *d, int dst, const Particles *p, int i) {
+    int *n = &d->sh->sent[d->rank][dst];
+    if (*n == d->cap) return 0;
+    DomainParticle *m = mailbox(d, d->rank, dst) + (*n)++;
+    for (int k = 0; k < NCOMP; k++) m->c[k] = p->c[k][i];
+    m->color = p->color[i];
+    return 1;
+}
+
+int domain_recv(const Domain *d, int src, const DomainParticle **out) {
+    *out = mailbox(d, src, d->rank);
+    return d->sh->sent[src][d->rank];
+}
+
+void domain_set_count(Domain *d, int n) {
+    d->sh->count[d->rank] = n;
+}
+
+long domain_count(const Domain *d) {
+    long n = 0;
+    for (int r = 0; r < d->nprocs; r++) n += d->sh->count[r];
+    return n;
+}
+
+static uint32_t *framebuffer(const Domain *d, int rank) {
+    char *fbs = (char *)mailbox(d, d->nprocs, 0);   // just past the last mailbox
+    return (uint32_t *)fbs + (size_t)rank * d->fb_pixels;
+}
+
+uint32_t *domain_framebuffer(Domain *d) {
+    return framebuffer(d, d->rank);
+}
+
+void domain_composite(const Domain *d, uint32_t *dst, int lo, int hi) {
+    int n = hi - lo;
+    memcpy(dst, framebuffer(d, 0) + lo, (size_t)n * sizeof(uint32_t));
+    for (int r = 1; r < d->nprocs; r++) {
+        const uint32_t *src = framebuffer(d, r) + lo;
+        for (int i = 0; i < n; i++) {
+            uint32_t a = dst[i], b = src[i], c = 0;
+            for (int s = 0; s < 24; s += 8) {
+                uint32_t ca = a >> s & 0xFF, cb = b >> s & 0xFF;
+                c |= (ca > cb ? ca : cb) << s;
+            }
+            dst[i] = c;
+        }
+    }
+}
+
+#else
+
+int domain_start(Domain *d, int nprocs, float world_w, int cap, int fb_pixels, int numa) {
+    (void)nprocs; (void)world_w; (void)cap; (void)fb_pixels; (void)numa;
+    memset(d, 0, sizeof(*d));
+    return 0;
+}
+
+void domain_stop(Domain *d) { (void)d; }
+void domain_sync(Domain *d) { (void)d; }
+void domain_post_cmd(Domain *d, const DomainCmd *c) { (void)d; (void)c; }
+void domain_wait_cmd(Domain *d, DomainCmd *c) { (void)d; memset(c, 0, sizeof(*c)); }
+void domain_clear(Domain *d) { (void)d; }
+int  domain_send(Domain *d, int dst, const Particles *p, int i) { (void)d; (void)dst; (void)p; (void)i; return 0; }
+int  domain_recv(const Domain *d, int src, const DomainParticle **out) { (void)d; (void)src; *out = NULL; return 0; }
+void domain_set_count(Domain *d, int n) { (void)d; (void)n; }
+long domain_count(const Domain *d) { (void)d; return 0; }
+uint32_t *domain_framebuffer(Domain *d) { (void)d; return NULL; }
+void domain_composite(const Domain *d, uint32_t *dst, int lo, int hi) { (void)d; (void)dst; (void)lo; (void)hi; }
+
+#endif
@@ -0,0 +1,81 @@
+// domain.h
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "particles.h"
+
+// Domain decomposition over local processes. The world is cut into nprocs
+// vertical slabs of equal width, one per process. Rank 0 is the process
+// that calls domain_start and coordinates; ranks 1 .. nprocs-1 are forked
+// from it and die with it. Everything they exchange goes through one shared
+// anonymous mapping: a command block, a mailbox for every (sender, receiver)
+// pair and a framebuffer per rank, with a process-shared barrier between
+// phases. Linux only; elsewhere domain_start fails.
+#define DOMAIN_MAX 64
+
+// A particle crossing a slab boundary: every component plus its colour
+typedef struct {
+    float c[NCOMP];
+    uint32_t color;
+} DomainParticle;
+
+// What rank 0 asks of the others
+enum {DOMAIN_QUIT, DOMAIN_STEP, DOMAIN_RENDER};
+
+typedef struct {
+    int cmd;
+    float dt, alpha;
+    float cx, cy, zoom;     // view for DOMAIN_RENDER
+    int render_mode, fade_mode, pixels;
+} DomainCmd;
+
+typedef struct DomainShared DomainShared;
+
+typedef struct {
+    int rank, nprocs;
+    float slab;             // slab width; rank r owns [r * slab, (r + 1) * slab)
+    int cap;                // particles per mailbox
+    int fb_pixels;
+    DomainShared *sh;
+    size_t bytes;           // size of the shared mapping
+    pid_t pid[DOMAIN_MAX];  // rank 0: the forked ranks
+} Domain;
+
+// Map the shared block and fork the other ranks. Returns in every process
+// with d->rank set, or 0 in the caller on failure (nothing left running).
+// With numa set, each rank pins itself to the CPUs of NUMA node
+// rank % nodes before it allocates anything, so first touch keeps its
+// particles, its outgoing mailboxes and its framebuffer on that node.
+int  domain_start(Domain *d, int nprocs, float world_w, int cap, int fb_pixels, int numa);
+void domain_stop(Domain *d);    // rank 0: send DOMAIN_QUIT, reap the others, unmap
+void domain_sync(Domain *d);    // barrier over all ranks
+
+// Rank 0 posts a command; the others block in domain_wait_cmd until it does
+void domain_post_cmd(Domain *d, const DomainCmd *c);
+void domain_wait_cmd(Domain *d, DomainCmd *c);
+
+static inline int domain_slab(const Domain *d, float x) {
+    int r = (int)(x / d->slab);
+    return r < 0 ? 0 : r >= d->nprocs ? d->nprocs - 1 : r;
+}
+
+// Mailboxes from this rank: domain_clear empties them, domain_send appends
+// particle i of p to the one for dst (0 when it is full). A receiver reads
+// its mailbox from src only between the barriers around a phase.
+void domain_clear(Domain *d);
+int  domain_send(Domain *d, int dst, const Particles *p, int i);
+int  domain_recv(const Domain *d, int src, const DomainParticle **out);
+
+// Particle counts: each rank sets its own, any rank reads the total as of
+// the last barrier
+void domain_set_count(Domain *d, int n);
+long domain_count(const Domain *d);
+
+// This rank's framebuffer, and pixels [lo, hi) of all of them merged into
+// dst[0 .. hi - lo) by per-channel maximum
+uint32_t *domain_framebuffer(Domain *d);
+void domain_composite(const Domain *d, uint32_t *dst, int lo, int hi);
+
+#endif // DOMAIN_H
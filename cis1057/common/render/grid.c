@@ -0,0 +1,51 @@
+// grid.c
+#include "grid.h"
+#include <stdlib.h>
+#include <string.h>
+
+int grid_init(Grid *g, float w, float h, float cell) {
+    memset(g, 0, sizeof(*g));
+    g->cell = cell;
+    g->inv_cell = 1.0f / cell;
+    g->cols = (int)(w / cell) + 1;
+    g->rows = (int)(h / cell) + 1;
+    g->start = calloc((size_t)g->cols * g->rows + 1, sizeof(int));
+    return g->start != NULL;
+}
+
+void grid_free(Grid *g) {
+    free(g->start);
+    free(g->items);
+    free(g->cell_of);
+    memset(g, 0, sizeof(*g));
+}
+
+int grid_build(Grid *g, const float *x, const float *y, int n) {
+    if (n > g->cap) {
+        int *items = realloc(g->items, (size_t)n * sizeof(int));
+        if (!items) return 0;
+        g->items = items;
+        int *cell_of = realloc(g->cell_of, (size_t)n * sizeof(int));
+        if (!cell_of) return 0;
+        g->cell_of = cell_of;
+        g->cap = n;
+    }
+
+    int ncells = g->cols * g->rows;
+    memset(g->start, 0, (size_t)(ncells + 1) * sizeof(int));
+
+    // Count particles per cell (shifted by one so the prefix sum lands in place)
+    for (int i = 0; i < n; i++) {
+        int c = grid_col(g, x[i]) + grid_row(g, y[i]) * g->cols;
+        g->cell_of[i] = c;
+        g->start[c + 1]++;
+    }
+    for (int c = 0; c < ncells; c++) g->start[c + 1] += g->start[c];
+
+    // Scatter; start[c] is used as the write cursor and restored afterwards
+    for (int i = 0; i < n; i++) g->items[g->start[g->cell_of[i]]++] = i;
+    for (int c = ncells; c > 0; c--) g->start[c] = g->start[c - 1];
+    g->start[0] = 0;
+
+    return 1;
+}
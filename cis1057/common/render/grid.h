@@ -0,0 +1,39 @@
+// grid.h
+#ifndef GRID_H
+#define GRID_H
+
+// Uniform cell list (broadphase) over a w x h world.
+// Particles are bucketed with a counting sort, so the members of each cell
+// are contiguous in items[start[c] .. start[c+1]).
+typedef struct {
+    float cell, inv_cell;   // cell edge length in pixels, and its inverse
+    int cols, rows;
+    int *start;             // cols * rows + 1 offsets into items
+    int *items;             // particle indices, grouped by cell
+    int *cell_of;           // cell index of each particle (build scratch)
+    int cap;                // capacity of items / cell_of
+} Grid;
+
+// Forward half of the 3x3 neighbourhood: together with the cell itself this
+// visits every pair of adjacent cells exactly once
+static const int GRID_STENCIL[4][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+
+// Allocate a grid covering [0,w) x [0,h) with the given cell size; returns 0 on failure
+int grid_init(Grid *g, float w, float h, float cell);
+void grid_free(Grid *g);
+
+// Rebucket n particles; returns 0 on allocation failure
+int grid_build(Grid *g, const float *x, const float *y, int n);
+
+// Cell coordinate of a world position, clamped to the grid
+static inline int grid_col(const Grid *g, float x) {
+    int c = (int)(x * g->inv_cell);
+    return c < 0 ? 0 : c >= g->cols ? g->cols - 1 : c;
+}
+
+static inline int grid_row(const Grid *g, float y) {
+    int r = (int)(y * g->inv_cell);
+    return r < 0 ? 0 : r >= g->rows ? g->rows - 1 : r;
+}
+
+#endif // GRID_H
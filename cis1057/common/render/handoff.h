@@ -0,0 +1,40 @@
+// handoff.h
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdatomic.h>
+
+// Triple buffer: one producer thread hands its newest result to one
+// consumer thread without locks or waiting. Of three slots the producer
+// owns one (back), the consumer one (front), and the third (middle), the
+// newest published, changes hands by one atomic exchange. A slot published
+// before the last was taken is overwritten, so the consumer always gets the
+// newest; a producer that must not drop work checks handoff_pending first.
+#define HANDOFF_FRESH 4         // in middle: published and not taken yet
+
+typedef struct {
+    atomic_int middle;
+    int back, front;
+} Handoff;
+
+#define HANDOFF_INIT {1, 0, 2}
+
+// Producer: publish back and take the old middle as the next back
+static inline void handoff_put(Handoff *h) {
+    int old = atomic_exchange_explicit(&h->middle, h->back | HANDOFF_FRESH, memory_order_acq_rel);
+    h->back = old & ~HANDOFF_FRESH;
+}
+
+// Consumer: swap front for the middle slot if it is newer; returns 0 if not
+static inline int handoff_take(Handoff *h) {
+    if (!(atomic_load_explicit(&h->middle, memory_order_relaxed) & HANDOFF_FRESH)) return 0;
+    h->front = atomic_exchange_explicit(&h->middle, h->front, memory_order_acq_rel) & ~HANDOFF_FRESH;
+    return 1;
+}
+
+// Either side: the last slot published has not been taken yet
+static inline int handoff_pending(Handoff *h) {
+    return atomic_load_explicit(&h->middle, memory_order_acquire) & HANDOFF_FRESH;
+}
+
+#endif // HANDOFF_H
@@ -0,0 +1,114 @@
+// hud.c
+#include "hud.h"
+#include <stdio.h>
+
+// 3x5 glyphs, one octal digit per row (top first), bit 2 = left column
+static const uint16_t font[128] = {
+    ['0'] = 075557, ['1'] = 026227, ['2'] = 071747, ['3'] = 071717,
+    ['4'] = 055711, ['5'] = 074717, ['6'] = 074757, ['7'] = 071111,
+    ['8'] = 075757, ['9'] = 075717,
+    ['A'] = 025755, ['B'] = 065656, ['C'] = 034443, ['D'] = 065556,
+    ['E'] = 074647, ['F'] = 074644, ['G'] = 034553, ['H'] = 055755,
+    ['I'] = 072227, ['J'] = 011152, ['K'] = 055655, ['L'] = 044447,
+    ['M'] = 057755, ['N'] = 065555, ['O'] = 025552, ['P'] = 065644,
+    ['Q'] = 025563, ['R'] = 065655, ['S'] = 034216, ['T'] = 072222,
+    ['U'] = 055557, ['V'] = 055552, ['W'] = 055775, ['X'] = 055255,
+    ['Y'] = 055222, ['Z'] = 071247,
+    ['.'] = 000002, [':'] = 002020, ['%'] = 051245, ['/'] = 011244,
+    ['-'] = 000700, ['_'] = 000007, ['+'] = 002720,
+};
+
+#define SCALE 2
+#define LINE (6 * SCALE + 4)        // 5 rows + 1 gap, plus padding
+#define PANEL_W 560
+#define GRAPH_H 60
+#define HISTORY 240                 // frames kept for the graph
+#define BUDGET (1.0 / 60.0)         // graph scale: the 60 Hz budget is half height
+
+#define BG     0x101018u
+#define TEXT   0xE0E0E0u
+#define DIM    0x808080u
+
+static float history[HISTORY];
+static int head, filled;
+static int bgr;
+
+void hud_set_bgr(int on) {
+    bgr = on;
+}
+
+void hud_frame(double seconds) {
+    history[head] = (float)seconds;
+    head = (head + 1) % HISTORY;
+    if (filled < HISTORY) filled++;
+}
+
+static void fill(uint32_t *fb, int w, int h, int x0, int y0, int x1, int y1, uint32_t c) {
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > w) x1 = w;
+    if (y1 > h) y1 = h;
+    if (bgr) c = (c & 0xFF) << 16 | (c & 0xFF00) | (c >> 16 & 0xFF);
+    for (int y = y0; y < y1; y++)
+        for (int x = x0; x < x1; x++) fb[x + y * w] = c;
+}
+
+int hud_text(uint32_t *fb, int w, int h, int x, int y, int scale, uint32_t c, const char *s) {
+    for (; *s; s++, x += 4 * scale) {
+        int ch = *s >= 'a' && *s <= 'z' ? *s - 'a' + 'A' : *s;
+        uint16_t g = ch > 0 && ch < 128 ? font[ch] : 0;
+        for (int row = 0; row < 5; row++) {
+            int bits = g >> (3 * (4 - row)) & 7;
+            for (int col = 0; col < 3; col++)
+                if (bits >> (2 - col) & 1)
+                    fill(fb, w, h, x + col * scale, y + row * scale,
+                         x + (col + 1) * scale, y + (row + 1) * scale, c);
+        }
+    }
+    return x;
+}
+
+void hud_size(int nphases, int *w, int *h) {
+    *w = PANEL_W;
+    *h = LINE * (nphases + 2) + GRAPH_H + 12;
+}
+
+void hud_draw(uint32_t *fb, int w, int h, const HudPhase *phases, int nphases) {
+    int panel_w, panel_h;
+    hud_size(nphases, &panel_w, &panel_h);
+    fill(fb, w, h, 0, 0, panel_w, panel_h, BG);
+
+    // Average over the last second or so of frames
+    double sum = 0.0;
+    int count = filled < 60 ? filled : 60;
+    for (int k = 1; k <= count; k++) sum += history[(head - k + HISTORY) % HISTORY];
+    double avg = count ? sum / count : 0.0;
+
+    char line[96];
+    snprintf(line, sizeof(line), "FPS %5.1f   FRAME %6.2f MS", avg > 0.0 ? 1.0 / avg : 0.0, avg * 1e3);
+    hud_text(fb, w, h, 8, 6, SCALE, TEXT, line);
+
+    // Frame-time graph, newest on the right; the dim line is the 60 Hz budget
+    int gy = 6 + LINE, bar = (PANEL_W - 16) / HISTORY;
+    if (bar < 1) bar = 1;
+    fill(fb, w, h, 8, gy + GRAPH_H / 2, 8 + bar * HISTORY, gy + GRAPH_H / 2 + 1, DIM);
+    for (int k = 0; k < filled; k++) {
+        float t = history[(head - filled + k + HISTORY) % HISTORY];
+        int bh = (int)(t / (2.0 * BUDGET) * GRAPH_H);
+        if (bh > GRAPH_H) bh = GRAPH_H;
+        uint32_t c = t <= BUDGET ? 0x40C040u : t <= 2 * BUDGET ? 0xD0B030u : 0xD04040u;
+        int x = 8 + (HISTORY - filled + k) * bar;
+        fill(fb, w, h, x, gy + GRAPH_H - bh, x + bar, gy + GRAPH_H, c);
+    }
+
+    int y = gy + GRAPH_H + 8;
+    hud_text(fb, w, h, 8, y, SCALE, DIM, "PHASE              MS     IPC   LLC MISS");
+    for (int k = 0; k < nphases; k++) {
+        const HudPhase *p = &phases[k];
+        y += LINE;
+        int n = snprintf(line, sizeof(line), "%-14.14s %7.3f", p->name, p->ms);
+        if (p->ipc >= 0.0 && n > 0)
+            snprintf(line + n, sizeof(line) - n, "  %6.2f %9.0fK", p->ipc, p->llc_misses / 1e3);
+        hud_text(fb, w, h, 8, y, SCALE, TEXT, line);
+    }
+}
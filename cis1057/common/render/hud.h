@@ -0,0 +1,33 @@
+// hud.h
+#ifndef HUD_H
+#define HUD_H
+
+#include <stdint.h>
+
+// On-screen timing overlay drawn straight into the framebuffer with a
+// built-in 3x5 bitmap font. Nothing here runs while the HUD is hidden
+// except hud_frame, which stores one number.
+
+typedef struct {
+    const char *name;
+    double ms;              // time spent in this phase last frame
+    double ipc;             // instructions per cycle, < 0 if not measured
+    double llc_misses;      // last-level cache misses, < 0 if not measured
+} HudPhase;
+
+// Channel order of the framebuffer: 0x00RRGGBB (the default) or, with bgr
+// set, 0x00BBGGRR
+void hud_set_bgr(int bgr);
+
+// Record the duration of a whole frame for the FPS readout and graph
+void hud_frame(double seconds);
+
+// Draw the panel (FPS, frame-time graph, one line per phase) at the top left
+void hud_draw(uint32_t *fb, int w, int h, const HudPhase *phases, int nphases);
+void hud_size(int nphases, int *w, int *h);     // of the panel hud_draw draws
+
+// Draw text in the 3x5 font, each font pixel scale x scale; unknown
+// characters are blank. Returns the x just past the text.
+int hud_text(uint32_t *fb, int w, int h, int x, int y, int scale, uint32_t c, const char *s);
+
+#endif // HUD_H
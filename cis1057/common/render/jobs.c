@@ -0,0 +1,229 @@
+// jobs.c
+#include "jobs.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_WORKERS 64          // per pool
+#define MAX_POOLS 4
+#define DEQUE_CAP 4096          // power of two; parallel_for never queues more chunks
+
+// Chase-Lev deque: the owner pushes/takes at bottom, thieves steal at top.
+// A task is a [lo, hi) range packed into one word so slots can be atomic.
+typedef struct {
+    _Alignas(64) atomic_long top;
+    _Alignas(64) atomic_long bottom;
+    _Atomic uint64_t buf[DEQUE_CAP];
+} Deque;
+
+#define EMPTY UINT64_MAX
+
+static inline uint64_t pack(int lo, int hi) { return (uint64_t)(uint32_t)lo << 32 | (uint32_t)hi; }
+
+static void deque_push(Deque *d, uint64_t task) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    atomic_store_explicit(&d->buf[b & (DEQUE_CAP - 1)], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+static uint64_t deque_take(Deque *d) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    uint64_t task = EMPTY;
+    if (t <= b) {
+        task = atomic_load_explicit(&d->buf[b & (DEQUE_CAP - 1)], memory_order_relaxed);
+        if (t == b) {
+            // Last item: race thieves for it
+            if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                    memory_order_seq_cst, memory_order_relaxed))
+                task = EMPTY;
+            atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+static uint64_t deque_steal(Deque *d) {
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) return EMPTY;
+    uint64_t task = atomic_load_explicit(&d->buf[t & (DEQUE_CAP - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+        return EMPTY;
+    return task;
+}
+
+// A pool: its workers and the one parallel_for in flight on it; batch makes
+// callers on other threads wait for theirs. Only the owner may take from
+// the bottom of a deque, so parallel_for fills them while no worker is in
+// work(): workers join a batch under lock and count themselves in busy.
+typedef struct {
+    Deque *deques;
+    pthread_t threads[MAX_WORKERS];
+    int nthreads;
+
+    JobFn fn;
+    void *arg;
+    atomic_int pending;         // chunks not yet finished
+    atomic_int busy;            // workers other than the caller inside work()
+
+    pthread_mutex_t batch, lock;
+    pthread_cond_t wake;
+    unsigned generation;        // bumped for every parallel_for
+    int stop;
+} Pool;
+
+static Pool g_pools[MAX_POOLS];
+static int g_npools;
+
+// Pool and worker index of this thread, and whether it is inside a job body
+static _Thread_local int tl_pool;
+static _Thread_local int tl_self;
+static _Thread_local int tl_in_job;
+
+// Run chunks until this batch is done: own deque first, then steal round-robin
+static void work(Pool *p, int self) {
+    while (atomic_load_explicit(&p->pending, memory_order_acquire) > 0) {
+        uint64_t task = deque_take(&p->deques[self]);
+        for (int k = 1; task == EMPTY && k < p->nthreads; k++)
+            task = deque_steal(&p->deques[(self + k) % p->nthreads]);
+        if (task == EMPTY) { sched_yield(); continue; }
+
+        tl_in_job = 1;
+        p->fn(p->arg, (int)(task >> 32), (int)(uint32_t)task, self);
+        tl_in_job = 0;
+        atomic_fetch_sub_explicit(&p->pending, 1, memory_order_release);
+    }
+}
+
+static void *worker_main(void *arg) {
+    int id = (int)(intptr_t)arg;
+    Pool *p = &g_pools[id / MAX_WORKERS];
+    unsigned seen = 0;
+    tl_pool = id / MAX_WORKERS;
+    tl_self = id % MAX_WORKERS;
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        while (p->generation == seen && !p->stop) pthread_cond_wait(&p->wake, &p->lock);
+        seen = p->generation;
+        int stop = p->stop;
+        if (!stop) atomic_fetch_add_explicit(&p->busy, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&p->lock);
+        if (stop) return NULL;
+        work(p, tl_self);
+        atomic_fetch_sub_explicit(&p->busy, 1, memory_order_release);
+    }
+}
+
+static int pool_start(int id, int nthreads) {
+    if (nthreads <= 0) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > MAX_WORKERS) nthreads = MAX_WORKERS;
+
+    Pool *p = &g_pools[id];
+    p->deques = aligned_alloc(64, sizeof(Deque) * (size_t)nthreads);
+    if (!p->deques) return 0;
+    for (int k = 0; k < nthreads; k++) {
+        atomic_init(&p->deques[k].top, 0);
+        atomic_init(&p->deques[k].bottom, 0);
+    }
+    atomic_init(&p->pending, 0);
+    atomic_init(&p->busy, 0);
+    pthread_mutex_init(&p->batch, NULL);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+
+    p->stop = 0;
+    p->nthreads = 1;
+    for (int k = 1; k < nthreads; k++) {
+        if (pthread_create(&p->threads[k], NULL, worker_main, (void *)(intptr_t)(id * MAX_WORKERS + k))) break;
+        p->nthreads++;
+    }
+    return 1;
+}
+
+int jobs_init(int nthreads) {
+    if (!pool_start(0, nthreads)) return 0;
+    g_npools = 1;
+    return 1;
+}
+
+int jobs_add_pool(int nthreads) {
+    if (g_npools < 1 || g_npools >= MAX_POOLS || !pool_start(g_npools, nthreads)) return 0;
+    return g_npools++;
+}
+
+int jobs_use_pool(int id) {
+    int old = tl_pool;
+    tl_pool = id > 0 && id < g_npools ? id : 0;
+    return old;
+}
+
+void jobs_shutdown(void) {
+    for (int id = 0; id < g_npools; id++) {
+        Pool *p = &g_pools[id];
+        pthread_mutex_lock(&p->lock);
+        p->stop = 1;
+        pthread_cond_broadcast(&p->wake);
+        pthread_mutex_unlock(&p->lock);
+        for (int k = 1; k < p->nthreads; k++) pthread_join(p->threads[k], NULL);
+        free(p->deques);
+        p->deques = NULL;
+        p->nthreads = 1;
+        pthread_mutex_destroy(&p->batch);
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->wake);
+    }
+    g_npools = 0;
+}
+
+int jobs_threads(void) {
+    int n = g_pools[tl_pool].nthreads;
+    return n > 1 ? n : 1;
+}
+
+void jobs_parallel_for(int n, int grain, JobFn fn, void *arg) {
+    if (n <= 0) return;
+    if (grain < 1) grain = 1;
+    if ((n + grain - 1) / grain > DEQUE_CAP) grain = (n + DEQUE_CAP - 1) / DEQUE_CAP;
+
+    // Not worth waking anyone; nested loops run inline on the calling worker
+    Pool *p = &g_pools[tl_pool];
+    if (p->nthreads <= 1 || n <= grain || tl_in_job) {
+        fn(arg, 0, n, tl_self);
+        return;
+    }
+
+    pthread_mutex_lock(&p->batch);
+    pthread_mutex_lock(&p->lock);
+    // Workers still leaving the last batch (or joining it late) find it done
+    while (atomic_load_explicit(&p->busy, memory_order_acquire) > 0) sched_yield();
+    p->fn = fn;
+    p->arg = arg;
+    int chunks = (n + grain - 1) / grain;
+    atomic_store_explicit(&p->pending, chunks, memory_order_release);
+
+    // Deal chunks round-robin so every worker starts on its own deque; push
+    // back-to-front so each owner takes its chunks in ascending order
+    for (int c = chunks - 1; c >= 0; c--) {
+        int lo = c * grain, hi = lo + grain < n ? lo + grain : n;
+        deque_push(&p->deques[c % p->nthreads], pack(lo, hi));
+    }
+
+    p->generation++;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+
+    work(p, 0);
+    pthread_mutex_unlock(&p->batch);
+}
@@ -0,0 +1,30 @@
+// jobs.h
+#ifndef JOBS_H
+#define JOBS_H
+
+// Fixed worker pools with per-worker work-stealing deques.
+// The calling thread is worker 0 of its pool and takes part in every
+// parallel_for. Threads outside a pool may all call in; their loops take
+// turns. Threads whose loops run at the same time and should not wait on
+// each other (a simulation and a renderer, say) use a pool each.
+
+// Body of a parallel loop: process [lo, hi); worker is in [0, jobs_threads())
+typedef void (*JobFn)(void *arg, int lo, int hi, int worker);
+
+// Start pool 0 with nthreads workers in total (<= 0: one per online CPU);
+// every thread calls into it until it picks another
+int jobs_init(int nthreads);
+void jobs_shutdown(void);       // stops every pool
+int jobs_threads(void);         // in the calling thread's pool
+
+// Start another pool the same way, after jobs_init; nthreads counts the
+// thread that will call in. Returns its id, or 0 if it cannot be started.
+int jobs_add_pool(int nthreads);
+// Send the calling thread's loops to pool id; returns the one it used
+int jobs_use_pool(int id);
+
+// Run fn over [0, n) in chunks of about grain items and wait for all of them.
+// Called from inside a job body, it runs the whole range inline instead.
+void jobs_parallel_for(int n, int grain, JobFn fn, void *arg);
+
+#endif // JOBS_H
@@ -0,0 +1,876 @@
+// kernels.c
+#include "kernels.h"
+#include "compact.h"
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+// ---- Scalar reference ----
+// Keep mul and add in separate statements so nothing fuses them into an FMA
+// that the vector paths would not match.
+
+static void integrate_scalar(float *x, float *y, const float *vx, const float *vy, int n, float dt) {
+    for (int i = 0; i < n; i++) {
+        float dx = vx[i] * dt, dy = vy[i] * dt;
+        x[i] += dx;
+        y[i] += dy;
+    }
+}
+
+static void integrate_dt_scalar(float *x, float *y, const float *vx, const float *vy, const float *dt, int n) {
+    for (int i = 0; i < n; i++) {
+        float dx = vx[i] * dt[i], dy = vy[i] * dt[i];
+        x[i] += dx;
+        y[i] += dy;
+    }
+}
+
+static void wrap_scalar(float *x, float *y, int n, float w, float h) {
+    for (int i = 0; i < n; i++) {
+        if (x[i] < 0) {
+            x[i] += w;
+        } else if (x[i] > w) {
+            x[i] -= w;
+        }
+        if (y[i] < 0) {
+            y[i] += h;
+        } else if (y[i] > h) {
+            y[i] -= h;
+        }
+    }
+}
+
+static void bounce_scalar(const float *x, const float *y, float *vx, float *vy, const float *r,
+                          int n, float w, float h, float e) {
+    for (int i = 0; i < n; i++) {
+        if (x[i] < r[i]) {
+            if (vx[i] < 0) vx[i] *= -e;
+        } else if (x[i] > w - r[i]) {
+            if (vx[i] > 0) vx[i] *= -e;
+        }
+        if (y[i] < r[i]) {
+            if (vy[i] < 0) vy[i] *= -e;
+        } else if (y[i] > h - r[i]) {
+            if (vy[i] > 0) vy[i] *= -e;
+        }
+    }
+}
+
+// Same steps and float conversion as rng_next / rng_float, one lane at a time
+static void uniform_scalar(RngWide *r, float *out, int n) {
+    for (int j = 0; j < n; j += RNG_LANES) {
+        for (int l = 0; l < RNG_LANES; l++) {
+            Rng lane = {{r->s[0][l], r->s[1][l], r->s[2][l], r->s[3][l]}};
+            out[j + l] = rng_float(&lane);
+            for (int k = 0; k < 4; k++) r->s[k][l] = lane.s[k];
+        }
+    }
+}
+
+static void fade_scalar(uint32_t *dst, const uint32_t *src, int n, uint32_t k) {
+    for (int i = 0; i < n; i++) {
+        uint32_t c = src[i];
+        uint32_t r = (c >> 16 & 0xFF) * k >> 8, g = (c >> 8 & 0xFF) * k >> 8, b = (c & 0xFF) * k >> 8;
+        dst[i] = r << 16 | g << 8 | b;
+    }
+}
+
+// Compact versions: one element at a time through the float kernels, so the
+// arithmetic is the same as theirs by construction
+// The high half of the hash dithers x, the low half y
+static void cintegrate_scalar(uint16_t *x, uint16_t *y, const uint16_t *vx, const uint16_t *vy, int n, float dt,
+                              uint32_t seed) {
+    for (int i = 0; i < n; i++) {
+        float fx = cpos_unpack(x[i]), fy = cpos_unpack(y[i]);
+        float fvx = half_unpack(vx[i]), fvy = half_unpack(vy[i]);
+        integrate_scalar(&fx, &fy, &fvx, &fvy, 1, dt);
+        uint32_t d = dither_hash(seed + (uint32_t)i);
+        x[i] = cpos_pack_dither(fx, (float)(d >> 16) * (1.0f / 65536.0f));
+        y[i] = cpos_pack_dither(fy, (float)(d & 0xFFFF) * (1.0f / 65536.0f));
+    }
+}
+
+static void cwrap_scalar(uint16_t *x, uint16_t *y, int n, float w, float h) {
+    for (int i = 0; i < n; i++) {
+        float fx = cpos_unpack(x[i]), fy = cpos_unpack(y[i]);
+        wrap_scalar(&fx, &fy, 1, w, h);
+        x[i] = cpos_pack(fx);
+        y[i] = cpos_pack(fy);
+    }
+}
+
+static void cbounce_scalar(const uint16_t *x, const uint16_t *y, uint16_t *vx, uint16_t *vy, const uint8_t *r,
+                           int n, float w, float h, float e) {
+    for (int i = 0; i < n; i++) {
+        float fx = cpos_unpack(x[i]), fy = cpos_unpack(y[i]), fr = crad_unpack(r[i]);
+        float fvx = half_unpack(vx[i]), fvy = half_unpack(vy[i]);
+        bounce_scalar(&fx, &fy, &fvx, &fvy, &fr, 1, w, h, e);
+        vx[i] = half_pack(fvx);
+        vy[i] = half_pack(fvy);
+    }
+}
+
+// ---- Pair rows ----
+// Canonical order for the vector paths: pair k is lane k % PAIR_LANES, and
+// i's lane sums are reduced as ((l0+l4) + (l2+l6)) + ((l1+l5) + (l3+l7)).
+// The scalar rows use IEEE sqrt and divide; the vector rows replace them
+// with rsqrt / rcp estimates refined by one Newton step (see kernels.h).
+// Fusing a*b + c would treat the gathered and scattered halves of a pair
+// differently, so this file opts out of contraction. GCC ignores the pragma
+// and only fuses in GNU modes with FMA enabled (-march=native, -mfma):
+// build kernels.c with -ffp-contract=off there.
+#ifdef __clang__
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+static float lane_sum(const float *s) {
+    float a0 = s[0] + s[4], a1 = s[1] + s[5], a2 = s[2] + s[6], a3 = s[3] + s[7];
+    float b0 = a0 + a2, b1 = a1 + a3;
+    return b0 + b1;
+}
+
+static inline float pair_rate(const PairArgs *a, int i) {
+    return a->dt ? a->dt[i] * a->inv_dt : 1.0f;
+}
+
+// Potential falling off with the surface gap; kicks scale by each particle's
+// inverse mass and share of the step
+static void repel_row_scalar(const PairArgs *a, int i, const int *js, int m) {
+    float xi = a->x[i], yi = a->y[i], ri = a->r[i];
+    float wi = pair_rate(a, i);
+    float mi = a->im[i] * wi;
+    float sx[PAIR_LANES] = {0}, sy[PAIR_LANES] = {0}, nn = INFINITY;
+    int any = 0;
+    for (int k = 0; k < m; k++) {
+        int j = js[k], l = k % PAIR_LANES;
+        float wj = pair_rate(a, j);
+        if (wi == 0.0f && wj == 0.0f) continue;
+        float dx = a->x[j] - xi, dy = a->y[j] - yi;
+        float dx2 = dx * dx, dy2 = dy * dy;
+        float d2 = dx2 + dy2;
+        if (!(d2 > 0.0f && d2 < a->cutoff2)) continue;
+
+        float dist = sqrtf(d2);
+        float inv = 1.0f / dist;
+        float gap = dist - ri - a->r[j];
+        gap = gap > 0.0f ? gap : 0.0f;
+        float gg = gap * gap;
+        float gap2 = gg + 1.0f;          // +1 to avoid singularity at contact
+        float f = a->strength / gap2;
+        float ux = dx * inv, uy = dy * inv;
+        float fx = ux * f, fy = uy * f;
+
+        float kx = fx * mi, ky = fy * mi;
+        sx[l] += kx;
+        sy[l] += ky;
+        float mj = a->im[j] * wj;
+        float jx = fx * mj, jy = fy * mj;
+        a->vx[j] += jx;
+        a->vy[j] += jy;
+        if (gap < nn) nn = gap;
+        if (a->nn && gap < a->nn[j]) a->nn[j] = gap;
+        any = 1;
+    }
+    if (!any) return;
+    a->vx[i] -= lane_sum(sx);
+    a->vy[i] -= lane_sum(sy);
+    if (a->nn && nn < a->nn[i]) a->nn[i] = nn;
+}
+
+// Elastic impulse between overlapping discs that are approaching. Mass is
+// proportional to r² (area); π cancels:
+//   j = 2 * mi * mj / (mi + mj) * dvn
+//   Δvi = -j/mi = -2 * mj / (mi + mj) * dvn
+//   Δvj = +j/mj = +2 * mi / (mi + mj) * dvn
+// A collision is instantaneous, so multi-rate shares do not scale it.
+// Each pair reads the velocity i has after the ones before it.
+static inline void collide_pair(const PairArgs *a, int i, int j, float nx, float ny, float ci, float cj) {
+    float dvx = a->vx[i] - a->vx[j], dvy = a->vy[i] - a->vy[j];
+    float px = dvx * nx, py = dvy * ny;
+    float dvn = px + py;
+    if (!(dvn > 0.0f)) return;
+    float fi = ci * dvn, fj = cj * dvn;
+    float ix = fi * nx, iy = fi * ny;
+    a->vx[i] -= ix;
+    a->vy[i] -= iy;
+    float jx = fj * nx, jy = fj * ny;
+    a->vx[j] += jx;
+    a->vy[j] += jy;
+}
+
+static void collide_row_scalar(const PairArgs *a, int i, const int *js, int m) {
+    float xi = a->x[i], yi = a->y[i], ri = a->r[i];
+    float wi = pair_rate(a, i);
+    float mi = ri * ri;
+    float nn = INFINITY;
+    for (int k = 0; k < m; k++) {
+        int j = js[k];
+        float wj = pair_rate(a, j);
+        if (wi == 0.0f && wj == 0.0f) continue;
+        float dx = a->x[j] - xi, dy = a->y[j] - yi;
+        float dx2 = dx * dx, dy2 = dy * dy;
+        float d2 = dx2 + dy2;
+        float dr = ri + a->r[j];
+        float dr2 = dr * dr;
+        if (!(d2 < dr2 && d2 > 0.0f)) continue;
+        nn = 0.0f;
+        if (a->nn) a->nn[j] = 0.0f;
+
+        float dist = sqrtf(d2);
+        float inv = 1.0f / dist;
+        float mj = a->r[j] * a->r[j];
+        float inv_mass_sum = 1.0f / (mi + mj);
+        float ci = 2.0f * mj * inv_mass_sum, cj = 2.0f * mi * inv_mass_sum;
+        collide_pair(a, i, j, dx * inv, dy * inv, ci, cj);
+    }
+    if (a->nn && nn < a->nn[i]) a->nn[i] = nn;
+}
+
+// Indices of block k0, padded with i past the end of the row (those lanes
+// come out with d2 == 0 and are masked off)
+static inline const int *row_block(const int *js, int k0, int m, int i, int *pad) {
+    if (m - k0 >= PAIR_LANES) return js + k0;
+    for (int l = 0; l < PAIR_LANES; l++) pad[l] = k0 + l < m ? js[k0 + l] : i;
+    return pad;
+}
+
+#ifdef HAVE_X86
+
+// ---- SSE2: 4 lanes, blends built from and/andnot/or ----
+
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+__attribute__((target("sse2")))
+static void integrate_sse2(float *x, float *y, const float *vx, const float *vy, int n, float dt) {
+    __m128 t = _mm_set1_ps(dt);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(_mm_loadu_ps(vx + i), t)));
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(_mm_loadu_ps(vy + i), t)));
+    }
+    integrate_scalar(x + i, y + i, vx + i, vy + i, n - i, dt);
+}
+
+__attribute__((target("sse2")))
+static void integrate_dt_sse2(float *x, float *y, const float *vx, const float *vy, const float *dt, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 t = _mm_loadu_ps(dt + i);
+        _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(_mm_loadu_ps(vx + i), t)));
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(_mm_loadu_ps(vy + i), t)));
+    }
+    integrate_dt_scalar(x + i, y + i, vx + i, vy + i, dt + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static inline __m128 wrap4(__m128 v, __m128 size, __m128 zero) {
+    __m128 lo = _mm_cmplt_ps(v, zero);
+    __m128 hi = _mm_andnot_ps(lo, _mm_cmpgt_ps(v, size));
+    v = select4(lo, _mm_add_ps(v, size), v);
+    return select4(hi, _mm_sub_ps(v, size), v);
+}
+
+__attribute__((target("sse2")))
+static void wrap_sse2(float *x, float *y, int n, float w, float h) {
+    __m128 vw = _mm_set1_ps(w), vh = _mm_set1_ps(h), zero = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(x + i, wrap4(_mm_loadu_ps(x + i), vw, zero));
+        _mm_storeu_ps(y + i, wrap4(_mm_loadu_ps(y + i), vh, zero));
+    }
+    wrap_scalar(x + i, y + i, n - i, w, h);
+}
+
+// Reflect v where (p < r and v < 0) or (p > size - r and v > 0)
+__attribute__((target("sse2")))
+static inline __m128 bounce4(__m128 p, __m128 v, __m128 r, __m128 size, __m128 ne, __m128 zero) {
+    __m128 lo = _mm_cmplt_ps(p, r);
+    __m128 hi = _mm_andnot_ps(lo, _mm_cmpgt_ps(p, _mm_sub_ps(size, r)));
+    __m128 flip = _mm_or_ps(_mm_and_ps(lo, _mm_cmplt_ps(v, zero)),
+                            _mm_and_ps(hi, _mm_cmpgt_ps(v, zero)));
+    return select4(flip, _mm_mul_ps(v, ne), v);
+}
+
+__attribute__((target("sse2")))
+static void bounce_sse2(const float *x, const float *y, float *vx, float *vy, const float *r,
+                        int n, float w, float h, float e) {
+    __m128 vw = _mm_set1_ps(w), vh = _mm_set1_ps(h), ne = _mm_set1_ps(-e), zero = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 ri = _mm_loadu_ps(r + i);
+        _mm_storeu_ps(vx + i, bounce4(_mm_loadu_ps(x + i), _mm_loadu_ps(vx + i), ri, vw, ne, zero));
+        _mm_storeu_ps(vy + i, bounce4(_mm_loadu_ps(y + i), _mm_loadu_ps(vy + i), ri, vh, ne, zero));
+    }
+    bounce_scalar(x + i, y + i, vx + i, vy + i, r + i, n - i, w, h, e);
+}
+
+// SSE2 has no 32-bit mullo, but the multipliers 5 and 9 are a shift and an add
+__attribute__((target("sse2")))
+static inline __m128i rotl4(__m128i x, int k) {
+    return _mm_or_si128(_mm_slli_epi32(x, k), _mm_srli_epi32(x, 32 - k));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 xoshiro4(__m128i *s0, __m128i *s1, __m128i *s2, __m128i *s3) {
+    __m128i x = _mm_add_epi32(_mm_slli_epi32(*s1, 2), *s1);
+    x = rotl4(x, 7);
+    x = _mm_add_epi32(_mm_slli_epi32(x, 3), x);
+    __m128i t = _mm_slli_epi32(*s1, 9);
+    *s2 = _mm_xor_si128(*s2, *s0);
+    *s3 = _mm_xor_si128(*s3, *s1);
+    *s1 = _mm_xor_si128(*s1, *s2);
+    *s0 = _mm_xor_si128(*s0, *s3);
+    *s2 = _mm_xor_si128(*s2, t);
+    *s3 = rotl4(*s3, 11);
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+}
+
+__attribute__((target("sse2")))
+static void uniform_sse2(RngWide *r, float *out, int n) {
+    // Two registers of four lanes each
+    for (int h = 0; h < RNG_LANES; h += 4) {
+        __m128i s0 = _mm_loadu_si128((const __m128i *)(r->s[0] + h));
+        __m128i s1 = _mm_loadu_si128((const __m128i *)(r->s[1] + h));
+        __m128i s2 = _mm_loadu_si128((const __m128i *)(r->s[2] + h));
+        __m128i s3 = _mm_loadu_si128((const __m128i *)(r->s[3] + h));
+        for (int j = 0; j < n; j += RNG_LANES) _mm_storeu_ps(out + j + h, xoshiro4(&s0, &s1, &s2, &s3));
+        _mm_storeu_si128((__m128i *)(r->s[0] + h), s0);
+        _mm_storeu_si128((__m128i *)(r->s[1] + h), s1);
+        _mm_storeu_si128((__m128i *)(r->s[2] + h), s2);
+        _mm_storeu_si128((__m128i *)(r->s[3] + h), s3);
+    }
+}
+
+// Fade: widen bytes to 16 bits, multiply (255 * 256 still fits), shift back
+// and narrow. Unpack and pack both work within 128-bit lanes, so pixel
+// order survives in the AVX2 version too.
+__attribute__((target("sse2")))
+static void fade_sse2(uint32_t *dst, const uint32_t *src, int n, uint32_t k) {
+    __m128i zero = _mm_setzero_si128(), kk = _mm_set1_epi16((short)k);
+    __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), kk), 8);
+        __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), kk), 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_and_si128(_mm_packus_epi16(lo, hi), rgb_mask));
+    }
+    fade_scalar(dst + i, src + i, n - i, k);
+}
+
+// Pair rows, 4 lanes at a time: lanes 0-3 of a PAIR_LANES block, then 4-7,
+// each half into its own half of i's lane sums. Without a gather the
+// operands are loaded lane by lane.
+static inline __m128 load4(const float *p, const int *j) {
+    return _mm_setr_ps(p[j[0]], p[j[1]], p[j[2]], p[j[3]]);
+}
+
+__attribute__((target("sse2")))
+static inline __m128 rsqrt4(__m128 x) {
+    __m128 e = _mm_rsqrt_ps(x);
+    __m128 hx = _mm_mul_ps(_mm_set1_ps(0.5f), x);
+    return _mm_mul_ps(e, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(hx, _mm_mul_ps(e, e))));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 rcp4(__m128 x) {
+    __m128 e = _mm_rcp_ps(x);
+    return _mm_mul_ps(e, _mm_sub_ps(_mm_set1_ps(2.0f), _mm_mul_ps(x, e)));
+}
+
+// Lanes 0-3 in lo, 4-7 in hi, reduced in the canonical order
+__attribute__((target("sse2")))
+static inline float lane_sum4x2(__m128 lo, __m128 hi) {
+    __m128 s = _mm_add_ps(lo, hi);
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("sse2")))
+static inline float lane_min4x2(__m128 lo, __m128 hi) {
+    __m128 s = _mm_min_ps(lo, hi);
+    s = _mm_min_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_min_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("sse2")))
+static inline __m128 row_due4(const PairArgs *a, const int *jp, float wi, __m128 *wj) {
+    __m128 all = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    *wj = _mm_set1_ps(1.0f);
+    if (!a->dt) return all;
+    *wj = _mm_mul_ps(load4(a->dt, jp), _mm_set1_ps(a->inv_dt));
+    return wi != 0.0f ? all : _mm_cmpneq_ps(*wj, _mm_setzero_ps());
+}
+
+__attribute__((target("sse2")))
+static void repel_row_sse2(const PairArgs *a, int i, const int *js, int m) {
+    float wi = pair_rate(a, i);
+    __m128 xi = _mm_set1_ps(a->x[i]), yi = _mm_set1_ps(a->y[i]), ri = _mm_set1_ps(a->r[i]);
+    __m128 mi = _mm_set1_ps(a->im[i] * wi);
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    __m128 cut2 = _mm_set1_ps(a->cutoff2), strength = _mm_set1_ps(a->strength);
+    __m128 sx[2] = {zero, zero}, sy[2] = {zero, zero}, nn[2];
+    nn[0] = nn[1] = _mm_set1_ps(INFINITY);
+    int pad[PAIR_LANES], any = 0;
+    float jx[4], jy[4], g[4];
+    for (int k0 = 0; k0 < m; k0 += PAIR_LANES) {
+        const int *block = row_block(js, k0, m, i, pad);
+        for (int h = 0; h < 2; h++) {
+            const int *jp = block + 4 * h;
+            __m128 wj, due = row_due4(a, jp, wi, &wj);
+            __m128 dx = _mm_sub_ps(load4(a->x, jp), xi), dy = _mm_sub_ps(load4(a->y, jp), yi);
+            __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            __m128 live = _mm_and_ps(due, _mm_and_ps(_mm_cmpgt_ps(d2, zero), _mm_cmplt_ps(d2, cut2)));
+            int bits = _mm_movemask_ps(live);
+            if (!bits) continue;
+
+            __m128 inv = rsqrt4(d2);
+            __m128 dist = _mm_mul_ps(d2, inv);
+            __m128 gap = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(dist, ri), load4(a->r, jp)), zero);
+            __m128 f = _mm_mul_ps(strength, rcp4(_mm_add_ps(_mm_mul_ps(gap, gap), one)));
+            __m128 fx = _mm_mul_ps(_mm_mul_ps(dx, inv), f), fy = _mm_mul_ps(_mm_mul_ps(dy, inv), f);
+
+            sx[h] = select4(live, _mm_add_ps(sx[h], _mm_mul_ps(fx, mi)), sx[h]);
+            sy[h] = select4(live, _mm_add_ps(sy[h], _mm_mul_ps(fy, mi)), sy[h]);
+            nn[h] = select4(live, _mm_min_ps(nn[h], gap), nn[h]);
+            __m128 mj = _mm_mul_ps(load4(a->im, jp), wj);
+            _mm_storeu_ps(jx, _mm_mul_ps(fx, mj));
+            _mm_storeu_ps(jy, _mm_mul_ps(fy, mj));
+            _mm_storeu_ps(g, gap);
+            for (int l = 0; l < 4; l++) {
+                if (!(bits >> l & 1)) continue;
+                int j = jp[l];
+                a->vx[j] += jx[l];
+                a->vy[j] += jy[l];
+                if (a->nn && g[l] < a->nn[j]) a->nn[j] = g[l];
+            }
+            any = 1;
+        }
+    }
+    if (!any) return;
+    a->vx[i] -= lane_sum4x2(sx[0], sx[1]);
+    a->vy[i] -= lane_sum4x2(sy[0], sy[1]);
+    float g_min = lane_min4x2(nn[0], nn[1]);
+    if (a->nn && g_min < a->nn[i]) a->nn[i] = g_min;
+}
+
+__attribute__((target("sse2")))
+static void collide_row_sse2(const PairArgs *a, int i, const int *js, int m) {
+    float wi = pair_rate(a, i), nn = INFINITY;
+    __m128 xi = _mm_set1_ps(a->x[i]), yi = _mm_set1_ps(a->y[i]), ri = _mm_set1_ps(a->r[i]);
+    __m128 mi = _mm_mul_ps(ri, ri);
+    __m128 zero = _mm_setzero_ps(), two = _mm_set1_ps(2.0f);
+    int pad[PAIR_LANES];
+    float nx[4], ny[4], ci[4], cj[4];
+    for (int k0 = 0; k0 < m; k0 += PAIR_LANES) {
+        const int *block = row_block(js, k0, m, i, pad);
+        for (int h = 0; h < 2; h++) {
+            const int *jp = block + 4 * h;
+            __m128 wj, due = row_due4(a, jp, wi, &wj);
+            __m128 dx = _mm_sub_ps(load4(a->x, jp), xi), dy = _mm_sub_ps(load4(a->y, jp), yi);
+            __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            __m128 rj = load4(a->r, jp);
+            __m128 dr = _mm_add_ps(ri, rj);
+            __m128 touch = _mm_and_ps(due, _mm_and_ps(_mm_cmplt_ps(d2, _mm_mul_ps(dr, dr)), _mm_cmpgt_ps(d2, zero)));
+            int bits = _mm_movemask_ps(touch);
+            if (!bits) continue;
+            nn = 0.0f;
+
+            __m128 inv = rsqrt4(d2);
+            __m128 mj = _mm_mul_ps(rj, rj);
+            __m128 inv_mass_sum = rcp4(_mm_add_ps(mi, mj));
+            _mm_storeu_ps(nx, _mm_mul_ps(dx, inv));
+            _mm_storeu_ps(ny, _mm_mul_ps(dy, inv));
+            _mm_storeu_ps(ci, _mm_mul_ps(_mm_mul_ps(two, mj), inv_mass_sum));
+            _mm_storeu_ps(cj, _mm_mul_ps(_mm_mul_ps(two, mi), inv_mass_sum));
+            for (int l = 0; l < 4; l++) {
+                if (!(bits >> l & 1)) continue;
+                if (a->nn) a->nn[jp[l]] = 0.0f;
+                collide_pair(a, i, jp[l], nx[l], ny[l], ci[l], cj[l]);
+            }
+        }
+    }
+    if (a->nn && nn < a->nn[i]) a->nn[i] = nn;
+}
+
+// ---- AVX2: 8 lanes, native blendv ----
+
+__attribute__((target("avx2")))
+static void integrate_avx2(float *x, float *y, const float *vx, const float *vy, int n, float dt) {
+    __m256 t = _mm256_set1_ps(dt);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(_mm256_loadu_ps(vx + i), t)));
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(_mm256_loadu_ps(vy + i), t)));
+    }
+    integrate_scalar(x + i, y + i, vx + i, vy + i, n - i, dt);
+}
+
+__attribute__((target("avx2")))
+static void integrate_dt_avx2(float *x, float *y, const float *vx, const float *vy, const float *dt, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 t = _mm256_loadu_ps(dt + i);
+        _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(_mm256_loadu_ps(vx + i), t)));
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(_mm256_loadu_ps(vy + i), t)));
+    }
+    integrate_dt_scalar(x + i, y + i, vx + i, vy + i, dt + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 wrap8(__m256 v, __m256 size, __m256 zero) {
+    __m256 lo = _mm256_cmp_ps(v, zero, _CMP_LT_OQ);
+    __m256 hi = _mm256_andnot_ps(lo, _mm256_cmp_ps(v, size, _CMP_GT_OQ));
+    v = _mm256_blendv_ps(v, _mm256_add_ps(v, size), lo);
+    return _mm256_blendv_ps(v, _mm256_sub_ps(v, size), hi);
+}
+
+__attribute__((target("avx2")))
+static void wrap_avx2(float *x, float *y, int n, float w, float h) {
+    __m256 vw = _mm256_set1_ps(w), vh = _mm256_set1_ps(h), zero = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(x + i, wrap8(_mm256_loadu_ps(x + i), vw, zero));
+        _mm256_storeu_ps(y + i, wrap8(_mm256_loadu_ps(y + i), vh, zero));
+    }
+    wrap_scalar(x + i, y + i, n - i, w, h);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 bounce8(__m256 p, __m256 v, __m256 r, __m256 size, __m256 ne, __m256 zero) {
+    __m256 lo = _mm256_cmp_ps(p, r, _CMP_LT_OQ);
+    __m256 hi = _mm256_andnot_ps(lo, _mm256_cmp_ps(p, _mm256_sub_ps(size, r), _CMP_GT_OQ));
+    __m256 flip = _mm256_or_ps(_mm256_and_ps(lo, _mm256_cmp_ps(v, zero, _CMP_LT_OQ)),
+                               _mm256_and_ps(hi, _mm256_cmp_ps(v, zero, _CMP_GT_OQ)));
+    return _mm256_blendv_ps(v, _mm256_mul_ps(v, ne), flip);
+}
+
+__attribute__((target("avx2")))
+static void bounce_avx2(const float *x, const float *y, float *vx, float *vy, const float *r,
+                        int n, float w, float h, float e) {
+    __m256 vw = _mm256_set1_ps(w), vh = _mm256_set1_ps(h), ne = _mm256_set1_ps(-e), zero = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 ri = _mm256_loadu_ps(r + i);
+        _mm256_storeu_ps(vx + i, bounce8(_mm256_loadu_ps(x + i), _mm256_loadu_ps(vx + i), ri, vw, ne, zero));
+        _mm256_storeu_ps(vy + i, bounce8(_mm256_loadu_ps(y + i), _mm256_loadu_ps(vy + i), ri, vh, ne, zero));
+    }
+    bounce_scalar(x + i, y + i, vx + i, vy + i, r + i, n - i, w, h, e);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rotl8(__m256i x, int k) {
+    return _mm256_or_si256(_mm256_slli_epi32(x, k), _mm256_srli_epi32(x, 32 - k));
+}
+
+__attribute__((target("avx2")))
+static void uniform_avx2(RngWide *r, float *out, int n) {
+    __m256i s0 = _mm256_loadu_si256((const __m256i *)r->s[0]);
+    __m256i s1 = _mm256_loadu_si256((const __m256i *)r->s[1]);
+    __m256i s2 = _mm256_loadu_si256((const __m256i *)r->s[2]);
+    __m256i s3 = _mm256_loadu_si256((const __m256i *)r->s[3]);
+    __m256i five = _mm256_set1_epi32(5), nine = _mm256_set1_epi32(9);
+    __m256 scale = _mm256_set1_ps(1.0f / 16777216.0f);
+    for (int j = 0; j < n; j += RNG_LANES) {
+        __m256i x = _mm256_mullo_epi32(rotl8(_mm256_mullo_epi32(s1, five), 7), nine);
+        __m256i t = _mm256_slli_epi32(s1, 9);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = rotl8(s3, 11);
+        _mm256_storeu_ps(out + j, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8)), scale));
+    }
+    _mm256_storeu_si256((__m256i *)r->s[0], s0);
+    _mm256_storeu_si256((__m256i *)r->s[1], s1);
+    _mm256_storeu_si256((__m256i *)r->s[2], s2);
+    _mm256_storeu_si256((__m256i *)r->s[3], s3);
+}
+
+// Compact storage: widen 8 values at a time to float lanes and narrow back
+
+__attribute__((target("avx2,f16c")))
+static inline __m256 cpos_load8(const uint16_t *q) {
+    __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)q)));
+    return _mm256_sub_ps(_mm256_mul_ps(f, _mm256_set1_ps(1.0f / CPOS_SCALE)), _mm256_set1_ps(CPOS_ORIGIN));
+}
+
+__attribute__((target("avx2,f16c")))
+static inline void cpos_store8(uint16_t *q, __m256 x) {
+    __m256 f = _mm256_mul_ps(_mm256_add_ps(x, _mm256_set1_ps(CPOS_ORIGIN)), _mm256_set1_ps(CPOS_SCALE));
+    f = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()), _mm256_set1_ps(65535.0f));
+    __m256i v = _mm256_cvtps_epi32(f);
+    _mm_storeu_si128((__m128i *)q, _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+__attribute__((target("avx2,f16c")))
+static inline void cpos_store8_dither(uint16_t *q, __m256 x, __m256 u) {
+    __m256 f = _mm256_mul_ps(_mm256_add_ps(x, _mm256_set1_ps(CPOS_ORIGIN)), _mm256_set1_ps(CPOS_SCALE));
+    f = _mm256_floor_ps(_mm256_add_ps(f, u));
+    f = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()), _mm256_set1_ps(65535.0f));
+    __m256i v = _mm256_cvtps_epi32(f);
+    _mm_storeu_si128((__m128i *)q, _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+__attribute__((target("avx2,f16c")))
+static inline __m256i dither_hash8(__m256i k) {
+    k = _mm256_xor_si256(k, _mm256_srli_epi32(k, 16));
+    k = _mm256_mullo_epi32(k, _mm256_set1_epi32(0x7FEB352D));
+    k = _mm256_xor_si256(k, _mm256_srli_epi32(k, 15));
+    k = _mm256_mullo_epi32(k, _mm256_set1_epi32((int)0x846CA68Bu));
+    return _mm256_xor_si256(k, _mm256_srli_epi32(k, 16));
+}
+
+__attribute__((target("avx2,f16c")))
+static inline __m256 half_load8(const uint16_t *h) {
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)h));
+}
+
+__attribute__((target("avx2,f16c")))
+static inline void half_store8(uint16_t *h, __m256 v) {
+    _mm_storeu_si128((__m128i *)h, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+}
+
+__attribute__((target("avx2,f16c")))
+static void cintegrate_avx2(uint16_t *x, uint16_t *y, const uint16_t *vx, const uint16_t *vy, int n, float dt,
+                            uint32_t seed) {
+    __m256 t = _mm256_set1_ps(dt), scale = _mm256_set1_ps(1.0f / 65536.0f);
+    __m256i k = _mm256_add_epi32(_mm256_set1_epi32((int)seed), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i lo16 = _mm256_set1_epi32(0xFFFF);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i d = dither_hash8(k);
+        __m256 ux = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(d, 16)), scale);
+        __m256 uy = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(d, lo16)), scale);
+        cpos_store8_dither(x + i, _mm256_add_ps(cpos_load8(x + i), _mm256_mul_ps(half_load8(vx + i), t)), ux);
+        cpos_store8_dither(y + i, _mm256_add_ps(cpos_load8(y + i), _mm256_mul_ps(half_load8(vy + i), t)), uy);
+        k = _mm256_add_epi32(k, _mm256_set1_epi32(8));
+    }
+    cintegrate_scalar(x + i, y + i, vx + i, vy + i, n - i, dt, seed + (uint32_t)i);
+}
+
+__attribute__((target("avx2,f16c")))
+static void cwrap_avx2(uint16_t *x, uint16_t *y, int n, float w, float h) {
+    __m256 vw = _mm256_set1_ps(w), vh = _mm256_set1_ps(h), zero = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        cpos_store8(x + i, wrap8(cpos_load8(x + i), vw, zero));
+        cpos_store8(y + i, wrap8(cpos_load8(y + i), vh, zero));
+    }
+    cwrap_scalar(x + i, y + i, n - i, w, h);
+}
+
+__attribute__((target("avx2,f16c")))
+static void cbounce_avx2(const uint16_t *x, const uint16_t *y, uint16_t *vx, uint16_t *vy, const uint8_t *r,
+                         int n, float w, float h, float e) {
+    __m256 vw = _mm256_set1_ps(w), vh = _mm256_set1_ps(h), ne = _mm256_set1_ps(-e), zero = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 ri = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(r + i))));
+        ri = _mm256_add_ps(_mm256_mul_ps(ri, _mm256_set1_ps(1.0f / CRAD_SCALE)), _mm256_set1_ps(CRAD_LO));
+        half_store8(vx + i, bounce8(cpos_load8(x + i), half_load8(vx + i), ri, vw, ne, zero));
+        half_store8(vy + i, bounce8(cpos_load8(y + i), half_load8(vy + i), ri, vh, ne, zero));
+    }
+    cbounce_scalar(x + i, y + i, vx + i, vy + i, r + i, n - i, w, h, e);
+}
+
+__attribute__((target("avx2")))
+static void fade_avx2(uint32_t *dst, const uint32_t *src, int n, uint32_t k) {
+    __m256i zero = _mm256_setzero_si256(), kk = _mm256_set1_epi16((short)k);
+    __m256i rgb_mask = _mm256_set1_epi32(0x00FFFFFF);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), kk), 8);
+        __m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), kk), 8);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_and_si256(_mm256_packus_epi16(lo, hi), rgb_mask));
+    }
+    fade_scalar(dst + i, src + i, n - i, k);
+}
+
+// Pair rows, PAIR_LANES j at a time: gather, compute every lane, keep the
+// live ones with blends, then scatter j's kicks lane by lane
+__attribute__((target("avx2")))
+static inline float lane_sum8(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2")))
+static inline float lane_min8(__m256 v) {
+    __m128 s = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_min_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_min_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+// 1 / sqrt(x) and 1 / x: the hardware estimate (12 bits) and one Newton step
+__attribute__((target("avx2")))
+static inline __m256 rsqrt8(__m256 x) {
+    __m256 e = _mm256_rsqrt_ps(x);
+    __m256 hx = _mm256_mul_ps(_mm256_set1_ps(0.5f), x);
+    return _mm256_mul_ps(e, _mm256_sub_ps(_mm256_set1_ps(1.5f), _mm256_mul_ps(hx, _mm256_mul_ps(e, e))));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 rcp8(__m256 x) {
+    __m256 e = _mm256_rcp_ps(x);
+    return _mm256_mul_ps(e, _mm256_sub_ps(_mm256_set1_ps(2.0f), _mm256_mul_ps(x, e)));
+}
+
+// Lanes whose pair is not idle at both ends
+__attribute__((target("avx2")))
+static inline __m256 row_due(const PairArgs *a, __m256i idx, float wi, __m256 *wj) {
+    *wj = _mm256_set1_ps(1.0f);
+    if (!a->dt) return _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    *wj = _mm256_mul_ps(_mm256_i32gather_ps(a->dt, idx, 4), _mm256_set1_ps(a->inv_dt));
+    __m256 zero = _mm256_setzero_ps();
+    if (wi != 0.0f) return _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    return _mm256_cmp_ps(*wj, zero, _CMP_NEQ_UQ);
+}
+
+__attribute__((target("avx2")))
+static void repel_row_avx2(const PairArgs *a, int i, const int *js, int m) {
+    float wi = pair_rate(a, i);
+    __m256 xi = _mm256_set1_ps(a->x[i]), yi = _mm256_set1_ps(a->y[i]), ri = _mm256_set1_ps(a->r[i]);
+    __m256 mi = _mm256_set1_ps(a->im[i] * wi);
+    __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    __m256 cut2 = _mm256_set1_ps(a->cutoff2), strength = _mm256_set1_ps(a->strength);
+    __m256 sx = zero, sy = zero, nn = _mm256_set1_ps(INFINITY);
+    int pad[PAIR_LANES], any = 0;
+    float jx[PAIR_LANES], jy[PAIR_LANES], g[PAIR_LANES];
+    for (int k0 = 0; k0 < m; k0 += PAIR_LANES) {
+        const int *jp = row_block(js, k0, m, i, pad);
+        __m256i idx = _mm256_loadu_si256((const __m256i *)jp);
+        __m256 wj, due = row_due(a, idx, wi, &wj);
+        __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(a->x, idx, 4), xi);
+        __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(a->y, idx, 4), yi);
+        __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        __m256 live = _mm256_and_ps(due, _mm256_and_ps(_mm256_cmp_ps(d2, zero, _CMP_GT_OQ),
+                                                       _mm256_cmp_ps(d2, cut2, _CMP_LT_OQ)));
+        int bits = _mm256_movemask_ps(live);
+        if (!bits) continue;
+
+        __m256 inv = rsqrt8(d2);
+        __m256 dist = _mm256_mul_ps(d2, inv);
+        __m256 rj = _mm256_i32gather_ps(a->r, idx, 4);
+        __m256 gap = _mm256_max_ps(_mm256_sub_ps(_mm256_sub_ps(dist, ri), rj), zero);
+        __m256 f = _mm256_mul_ps(strength, rcp8(_mm256_add_ps(_mm256_mul_ps(gap, gap), one)));
+        __m256 fx = _mm256_mul_ps(_mm256_mul_ps(dx, inv), f);
+        __m256 fy = _mm256_mul_ps(_mm256_mul_ps(dy, inv), f);
+
+        sx = _mm256_blendv_ps(sx, _mm256_add_ps(sx, _mm256_mul_ps(fx, mi)), live);
+        sy = _mm256_blendv_ps(sy, _mm256_add_ps(sy, _mm256_mul_ps(fy, mi)), live);
+        nn = _mm256_blendv_ps(nn, _mm256_min_ps(nn, gap), live);
+        __m256 mj = _mm256_mul_ps(_mm256_i32gather_ps(a->im, idx, 4), wj);
+        _mm256_storeu_ps(jx, _mm256_mul_ps(fx, mj));
+        _mm256_storeu_ps(jy, _mm256_mul_ps(fy, mj));
+        _mm256_storeu_ps(g, gap);
+        for (int l = 0; l < PAIR_LANES; l++) {
+            if (!(bits >> l & 1)) continue;
+            int j = jp[l];
+            a->vx[j] += jx[l];
+            a->vy[j] += jy[l];
+            if (a->nn && g[l] < a->nn[j]) a->nn[j] = g[l];
+        }
+        any = 1;
+    }
+    if (!any) return;
+    a->vx[i] -= lane_sum8(sx);
+    a->vy[i] -= lane_sum8(sy);
+    float g_min = lane_min8(nn);
+    if (a->nn && g_min < a->nn[i]) a->nn[i] = g_min;
+}
+
+__attribute__((target("avx2")))
+static void collide_row_avx2(const PairArgs *a, int i, const int *js, int m) {
+    float wi = pair_rate(a, i), nn = INFINITY;
+    __m256 xi = _mm256_set1_ps(a->x[i]), yi = _mm256_set1_ps(a->y[i]), ri = _mm256_set1_ps(a->r[i]);
+    __m256 mi = _mm256_mul_ps(ri, ri);
+    __m256 zero = _mm256_setzero_ps(), two = _mm256_set1_ps(2.0f);
+    int pad[PAIR_LANES];
+    float nx[PAIR_LANES], ny[PAIR_LANES], ci[PAIR_LANES], cj[PAIR_LANES];
+    for (int k0 = 0; k0 < m; k0 += PAIR_LANES) {
+        const int *jp = row_block(js, k0, m, i, pad);
+        __m256i idx = _mm256_loadu_si256((const __m256i *)jp);
+        __m256 wj, due = row_due(a, idx, wi, &wj);
+        __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(a->x, idx, 4), xi);
+        __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(a->y, idx, 4), yi);
+        __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        __m256 rj = _mm256_i32gather_ps(a->r, idx, 4);
+        __m256 dr = _mm256_add_ps(ri, rj);
+        __m256 touch = _mm256_and_ps(due, _mm256_and_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(dr, dr), _CMP_LT_OQ),
+                                                        _mm256_cmp_ps(d2, zero, _CMP_GT_OQ)));
+        int bits = _mm256_movemask_ps(touch);
+        if (!bits) continue;
+        nn = 0.0f;
+
+        // The geometry is vectorised; the impulses go pair by pair, in row order
+        __m256 inv = rsqrt8(d2);
+        __m256 mj = _mm256_mul_ps(rj, rj);
+        __m256 inv_mass_sum = rcp8(_mm256_add_ps(mi, mj));
+        _mm256_storeu_ps(nx, _mm256_mul_ps(dx, inv));
+        _mm256_storeu_ps(ny, _mm256_mul_ps(dy, inv));
+        _mm256_storeu_ps(ci, _mm256_mul_ps(_mm256_mul_ps(two, mj), inv_mass_sum));
+        _mm256_storeu_ps(cj, _mm256_mul_ps(_mm256_mul_ps(two, mi), inv_mass_sum));
+        for (int l = 0; l < PAIR_LANES; l++) {
+            if (!(bits >> l & 1)) continue;
+            if (a->nn) a->nn[jp[l]] = 0.0f;
+            collide_pair(a, i, jp[l], nx[l], ny[l], ci[l], cj[l]);
+        }
+    }
+    if (a->nn && nn < a->nn[i]) a->nn[i] = nn;
+}
+
+#endif // HAVE_X86
+
+void kernels_select(Kernels *k, CpuLevel l) {
+    k->integrate = integrate_scalar;
+    k->integrate_dt = integrate_dt_scalar;
+    k->wrap      = wrap_scalar;
+    k->bounce    = bounce_scalar;
+    k->uniform   = uniform_scalar;
+    k->fade      = fade_scalar;
+    k->cintegrate = cintegrate_scalar;
+    k->cwrap      = cwrap_scalar;
+    k->cbounce    = cbounce_scalar;
+    k->repel_row   = repel_row_scalar;
+    k->collide_row = collide_row_scalar;
+#ifdef HAVE_X86
+    if (l >= CPU_SSE2) {
+        k->integrate = integrate_sse2;
+        k->integrate_dt = integrate_dt_sse2;
+        k->wrap      = wrap_sse2;
+        k->bounce    = bounce_sse2;
+        k->uniform   = uniform_sse2;
+        k->fade      = fade_sse2;
+        k->repel_row   = repel_row_sse2;
+        k->collide_row = collide_row_sse2;
+    }
+    if (l >= CPU_AVX2) {
+        k->integrate = integrate_avx2;
+        k->integrate_dt = integrate_dt_avx2;
+        k->wrap      = wrap_avx2;
+        k->bounce    = bounce_avx2;
+        k->uniform   = uniform_avx2;
+        k->fade      = fade_avx2;
+        k->cintegrate = cintegrate_avx2;
+        k->cwrap      = cwrap_avx2;
+        k->cbounce    = cbounce_avx2;
+        k->repel_row   = repel_row_avx2;
+        k->collide_row = collide_row_avx2;
+    }
+#else
+    (void)l;
+#endif
+}
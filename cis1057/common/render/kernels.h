@@ -0,0 +1,75 @@
+// kernels.h
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "cpu.h"
+#include "rng.h"
+#include <stdint.h>
+
+// Pair rows: particle i against particles js[0 .. m), each pair visited once.
+// j gets its kicks straight away. Repel sums i's in PAIR_LANES partial sums
+// (pair k goes to lane k % PAIR_LANES), reduced in a fixed order after the
+// row; collision applies them pair by pair, since later pairs read i's
+// velocity. The vector rows take 1 / dist and the divides from rsqrt / rcp
+// estimates and one Newton step, so a row's kicks are within ROW_TOLERANCE
+// of the scalar ones (relative to the largest; rowcheck measures it). The
+// estimates differ between SIMD levels and CPU vendors: a run repeats
+// exactly across thread counts and replays on one machine, not across
+// levels or machines. Snapshots record the level (sim_load_exact).
+#define PAIR_LANES 8
+#define ROW_TOLERANCE 2e-6
+
+typedef struct {
+    float *x, *y, *vx, *vy;
+    const float *r, *im;    // radius, inverse mass
+    const float *dt;        // multi-rate timesteps, or NULL at a single rate:
+    float inv_dt;           //   kicks scale by dt * inv_dt, idle pairs are skipped
+    float *nn;              // nearest surface gap to update, or NULL
+    float strength, cutoff2;
+} PairArgs;
+
+typedef void (*PairRow)(const PairArgs *a, int i, const int *js, int m);
+
+// Element-wise particle kernels over n consecutive particles.
+// Every variant produces bit-identical results to the scalar one: the vector
+// paths replace branches with compare masks and blends, never with
+// arithmetic that could round differently (e.g. adding a masked 0).
+typedef struct {
+    void (*integrate)(float *x, float *y, const float *vx, const float *vy, int n, float dt);
+    // Same with a timestep per particle
+    void (*integrate_dt)(float *x, float *y, const float *vx, const float *vy, const float *dt, int n);
+    void (*wrap)(float *x, float *y, int n, float w, float h);
+    void (*bounce)(const float *x, const float *y, float *vx, float *vy, const float *r,
+                   int n, float w, float h, float e);
+    // n uniform floats in [0,1) (n a multiple of RNG_LANES); out[j * RNG_LANES + l]
+    // is the j-th output of lane l
+    void (*uniform)(RngWide *r, float *out, int n);
+
+    // The same passes over compact storage (see compact.h): unpack, do the
+    // float arithmetic above, round back. No SSE2 variants (no F16C there).
+    // cintegrate dithers element i with dither_hash(seed + i).
+    void (*cintegrate)(uint16_t *x, uint16_t *y, const uint16_t *vx, const uint16_t *vy, int n, float dt,
+                       uint32_t seed);
+    void (*cwrap)(uint16_t *x, uint16_t *y, int n, float w, float h);
+    void (*cbounce)(const uint16_t *x, const uint16_t *y, uint16_t *vx, uint16_t *vy, const uint8_t *r,
+                    int n, float w, float h, float e);
+
+    // dst = the n 0RGB pixels of src with their channels scaled by k / 256
+    // (k <= 256, see fade_factor), rounding down; the top byte comes out 0.
+    // dst may be src.
+    void (*fade)(uint32_t *dst, const uint32_t *src, int n, uint32_t k);
+
+    // Pair rows (see above)
+    PairRow repel_row, collide_row;
+} Kernels;
+
+// Fade factor f in [0, 1] in the 1/256 steps kernels.fade takes
+static inline uint32_t fade_factor(float f) {
+    f = f < 0.0f ? 0.0f : f > 1.0f ? 1.0f : f;
+    return (uint32_t)(f * 256.0f + 0.5f);
+}
+
+// Fill k with the best variants for level l
+void kernels_select(Kernels *k, CpuLevel l);
+
+#endif // KERNELS_H
@@ -1,35 +1,465 @@
 #include "app.h"
 #include "sim.h"
+#include "hud.h"
+#include "perfctr.h"
+#include "record.h"
+#include "handoff.h"
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Physics runs at SIM_HZ whatever the frame rate; each frame consumes the
+// elapsed wall time in fixed steps and renders in between the last two.
+#define SIM_HZ     120
+#define RENDER_HZ  60      // target when the limiter is on
+#define MAX_STEPS  8       // per frame; beyond this the sim slows down instead
+                           // of falling further behind (spiral of death)
+
+// HUD phase timing: wall clock always, hardware counters when SIM_PERF is set
+// and perf_event_open is allowed
+typedef struct {
+    double t;
+    PerfSample ps;
+} Mark;
+
+static int perf_on;
+
+static void mark(Mark *m) {
+    m->t = app_time();
+    if (perf_on) perf_read(&m->ps);
+}
+
+static HudPhase phase(const char *name, const Mark *a, const Mark *b) {
+    HudPhase p = {name, (b->t - a->t) * 1e3, -1.0, -1.0};
+    if (perf_on) {
+        uint64_t cycles = b->ps.cycles - a->ps.cycles;
+        p.ipc = cycles ? (double)(b->ps.instructions - a->ps.instructions) / cycles : 0.0;
+        p.llc_misses = (double)(b->ps.llc_misses - a->ps.llc_misses);
+    }
+    return p;
+}
+
+#define MAX_PHASES 16
+
+// Camera: the arrow keys pan, SHIFT+UP / SHIFT+DOWN zoom. Panning speed is
+// in screen pixels so it feels the same at any zoom; zoom runs from fitting
+// the whole world down to MAX_ZOOM screen pixels per world pixel.
+#define PAN_SPEED  900.0f      // screen pixels per second
+#define ZOOM_RATE  2.0f        // factor per second
+#define MAX_ZOOM   8.0f
+
+typedef struct {
+    float cx, cy, zoom, fit;
+    int ww, wh;
+} Camera;
+
+static void camera_init(Camera *c) {
+    sim_world(&c->ww, &c->wh);
+    c->fit = fminf((float)W / c->ww, (float)H / c->wh);
+    c->zoom = c->fit;
+    c->cx = 0.5f * c->ww;
+    c->cy = 0.5f * c->wh;
+}
+
+static void camera_update(Camera *c, const Input *in, float dt) {
+    int zooming = in->down[KEY_SHIFT];
+    float pan = PAN_SPEED * dt / c->zoom;
+    c->cx += pan * (in->down[KEY_RIGHT] - in->down[KEY_LEFT]);
+    if (zooming) c->zoom *= powf(ZOOM_RATE, dt * (in->down[KEY_UP] - in->down[KEY_DOWN]));
+    else c->cy += pan * (in->down[KEY_UP] - in->down[KEY_DOWN]);
+    c->zoom = fminf(fmaxf(c->zoom, c->fit), MAX_ZOOM);
+    c->cx = fminf(fmaxf(c->cx, 0.0f), (float)c->ww);
+    c->cy = fminf(fmaxf(c->cy, 0.0f), (float)c->wh);
+}
+
+// Record/replay: the run's starting state goes to FILE.snap and a per-frame
+// log of step counts and input to FILE. Every SNAP_EVERY steps the state is
+// also kept in an in-memory ring, so a replay can rewind (SHIFT) a few
+// seconds and step forward again from there; SPACE pauses a replay. SHIFT
+// also zooms the camera, so a rewind takes a tap of SHIFT on its own.
+#define SNAP_EVERY    600
+#define REWIND_STEPS  (5 * SIM_HZ)
+
+// Pipelined loop (--pipeline): the sim steps on a thread of its own and
+// publishes each frame's particles (sim_publish), a render thread draws the
+// newest into a ring of three frames, and this thread pumps input and
+// presents, so a frame costs about the slowest of the three instead of
+// their sum. Sim and render loops run on separate workers
+// (sim_set_render_threads). The ring is framebuffers of ours, which keep
+// the trails: each frame fades the last over from its slot, which only
+// this thread reads meanwhile. Where the renderer lets window textures be
+// drawn into, every frame is also written out to one of APP_FRAMES locked
+// ones as it is drawn and shown without an upload (locked memory is
+// write-only, so it is never the trail); else app_present uploads the
+// slot. Each hand-off is a triple buffer (handoff.h); a stage that gets
+// ahead naps until the next one takes its last result rather than
+// overwriting it. That holds at most one frame between stages, so the
+// latency from publish to on screen stays within a few frame times; the
+// HUD shows it ("latency") and the mean and worst are printed at exit,
+// next to the same for the loop without the pipeline.
+#define NAP 0.0005              // seconds a waiting stage sleeps between polls
+
+static atomic_int quit;
+static _Atomic float view_cx, view_cy, view_zoom;
+static atomic_int hud_on = 1, mode_flips;
+static _Atomic double sim_ms, render_ms, present_ms, latency_ms;
+
+static uint32_t *ring[3];
+static uint32_t *ring_out[3];   // app_lock_frame(k) for ring[k], or all NULL
+static int ring_pitch[3];       // of ring_out
+static double ring_tag[3];      // publish time of the scene in each
+static Handoff frames = HANDOFF_INIT;
+
+static void nap(void) {
+    struct timespec ts = {0, (long)(NAP * 1e9)};
+    nanosleep(&ts, NULL);
+}
+
+static void *sim_thread(void *arg) {
+    (void)arg;
+    const double step = 1.0 / SIM_HZ;
+    double acc = 0.0;
+    for (double last = app_time(); !atomic_load(&quit); ) {
+        if (sim_published_pending()) {
+            nap();
+            continue;
+        }
+        double t0 = app_time();
+        acc += t0 - last;
+        last = t0;
+        if (acc > MAX_STEPS * step) acc = MAX_STEPS * step;
+        for (; acc >= step; acc -= step) sim_step((float)step);
+        if (!sim_publish((float)(acc / step), app_time())) {
+            fprintf(stderr, "cannot publish the particles for rendering\n");
+            atomic_store(&quit, 1);
+        }
+        atomic_store(&sim_ms, (app_time() - t0) * 1e3);
+    }
+    return NULL;
+}
+
+static void *render_thread(void *arg) {
+    (void)arg;
+    int flips = 0;
+    for (double last = app_time(); !atomic_load(&quit); ) {
+        if (handoff_pending(&frames)) {
+            nap();
+            continue;
+        }
+        sim_set_view(atomic_load(&view_cx), atomic_load(&view_cy), atomic_load(&view_zoom));
+        double t0 = app_time();
+        int k = frames.back;
+        if (!sim_render_published(ring[k], ring_out[k], ring_pitch[k], &ring_tag[k])) {
+            nap();
+            continue;
+        }
+        double t1 = app_time();
+        atomic_store(&render_ms, (t1 - t0) * 1e3);
+        hud_frame(t0 - last);
+        last = t0;
+        // M flips between discs and density splats from the next frame on
+        for (; flips != atomic_load(&mode_flips); flips++)
+            sim_set_render(sim_render_mode() == SIM_RENDER_DENSITY ? SIM_RENDER_DISCS : SIM_RENDER_DENSITY);
+
+        if (atomic_load(&hud_on)) {
+            HudPhase phases[] = {
+                {"sim_step", atomic_load(&sim_ms), -1.0, -1.0},
+                {"sim_render", atomic_load(&render_ms), -1.0, -1.0},
+                {"app_present", atomic_load(&present_ms), -1.0, -1.0},
+                {"latency", atomic_load(&latency_ms), -1.0, -1.0},
+            };
+            int np = (int)(sizeof(phases) / sizeof(phases[0])), hud_w, hud_h;
+            if (ring_out[k]) {
+                hud_draw(ring_out[k], ring_pitch[k], H, phases, np);
+            } else {
+                // The next frame fades this one, HUD and all
+                hud_draw(ring[k], W, H, phases, np);
+                hud_size(np, &hud_w, &hud_h);
+                sim_render_touched(ring[k], 0, 0, hud_w, hud_h);
+            }
+        }
+        handoff_put(&frames);
+    }
+    return NULL;
+}
+
+// Returns 0 if the threads or framebuffers cannot be had
+static int run_pipeline(uint32_t *fb, Camera *cam) {
+    ring[0] = fb;
+    ring[1] = calloc((size_t)W * H, sizeof(uint32_t));
+    ring[2] = calloc((size_t)W * H, sizeof(uint32_t));
+    int locked = 1;
+    for (int k = 0; k < 3 && locked; k++) locked = (ring_out[k] = app_lock_frame(k, &ring_pitch[k])) != NULL;
+    if (!locked) memset(ring_out, 0, sizeof(ring_out));     // all or none
+    pthread_t sim, render;
+    int ok = ring[1] && ring[2] && pthread_create(&sim, NULL, sim_thread, NULL) == 0;
+    if (ok && pthread_create(&render, NULL, render_thread, NULL) != 0) {
+        atomic_store(&quit, 1);
+        pthread_join(sim, NULL);
+        ok = 0;
+    }
+    if (!ok) {
+        free(ring[1]);
+        free(ring[2]);
+        return 0;
+    }
+
+    Input in = {0};
+    int limit_fps = 1;
+    long shown = 0;
+    double lat_sum = 0.0, lat_max = 0.0, shown_at = app_time();
+    for (double last = app_time(); !atomic_load(&quit) && app_pump(&in) && !in.pressed[KEY_ESC]; ) {
+        if (in.pressed[KEY_L]) limit_fps = !limit_fps;
+        if (in.pressed[KEY_F]) atomic_store(&hud_on, !atomic_load(&hud_on));
+        if (in.pressed[KEY_M]) atomic_fetch_add(&mode_flips, 1);
+
+        double now = app_time();
+        camera_update(cam, &in, (float)(now - last));
+        last = now;
+        atomic_store(&view_cx, cam->cx);
+        atomic_store(&view_cy, cam->cy);
+        atomic_store(&view_zoom, cam->zoom);
+
+        if (!handoff_take(&frames)) {
+            nap();
+            continue;
+        }
+        if (limit_fps) app_sleep(1.0 / RENDER_HZ - (app_time() - shown_at));
+        double t0 = app_time();
+        int k = frames.front;
+        if (ring_out[k]) {
+            app_present_locked(k);
+            // Locked again for the render thread, which gets the slot back
+            // through the hand-offs; the memory may move
+            ring_out[k] = app_lock_frame(k, &ring_pitch[k]);
+        } else {
+            app_present(ring[k]);
+        }
+        shown_at = app_time();
+        double lat = shown_at - ring_tag[frames.front];
+        atomic_store(&present_ms, (shown_at - t0) * 1e3);
+        atomic_store(&latency_ms, lat * 1e3);
+        shown++;
+        lat_sum += lat;
+        lat_max = fmax(lat_max, lat);
+    }
+    atomic_store(&quit, 1);
+    pthread_join(sim, NULL);
+    pthread_join(render, NULL);
+    if (shown)
+        printf("pipeline: %ld frames, publish to screen %.1f ms mean, %.1f ms worst\n",
+               shown, lat_sum / shown * 1e3, lat_max * 1e3);
+    free(ring[1]);
+    free(ring[2]);
+    return 1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [particles] [threads] [--load FILE.snap] [--world WxH]\n"
+                    "          [--procs P [--numa]] [--record FILE | --replay FILE | --pipeline]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int n = 300, pos = 0, procs = 1, numa = 0, pipelined = 0;
+    const char *load = NULL, *record = NULL, *replay = NULL;
+    for (int a = 1; a < argc; a++) {
+        const char *arg = argv[a], *val = a + 1 < argc ? argv[a + 1] : NULL;
+        if (strncmp(arg, "--", 2) != 0) {
+            if (pos++ == 0) n = atoi(arg);
+            else sim_set_threads(atoi(arg));
+            continue;
+        }
+        if (strcmp(arg, "--numa") == 0) { numa = 1; continue; }
+        if (strcmp(arg, "--pipeline") == 0) { pipelined = 1; continue; }
+        if (!val) { usage(argv[0]); return 1; }
+        if      (strcmp(arg, "--load") == 0)   load = val;
+        else if (strcmp(arg, "--procs") == 0)  procs = atoi(val);
+        else if (strcmp(arg, "--record") == 0) record = val;
+        else if (strcmp(arg, "--replay") == 0) replay = val;
+        else if (strcmp(arg, "--world") == 0) {
+            int w, h;
+            if (sscanf(val, "%dx%d", &w, &h) != 2 || !sim_set_world(w, h)) { usage(argv[0]); return 1; }
+        }
+        else { usage(argv[0]); return 1; }
+        a++;
+    }
+    // Record / replay log the steps of each frame, and several processes
+    // render in lockstep; neither runs pipelined
+    if ((record && replay) || (pipelined && (record || replay || procs > 1))) { usage(argv[0]); return 1; }
+    // Snapshots need every particle in one process
+    if ((procs > 1 && (load || record || replay)) || !sim_set_procs(procs, numa)) { usage(argv[0]); return 1; }
+
+    char snap_path[1024];
+    const char *log_path = record ? record : replay;
+    if (log_path) snprintf(snap_path, sizeof(snap_path), "%s.snap", log_path);
+    if (replay) load = snap_path;
+
+    long frame = 0;
+    Recorder rec = {0};
+    if (pipelined) sim_set_render_threads(-1);
+    sim_init(n);
+    sim_set_fade(SIM_FADE_LAZY);
+    if (load && !sim_load(load, &frame)) {
+        fprintf(stderr, "cannot load snapshot %s\n", load);
+        return 1;
+    }
+    if (replay && !sim_load_exact())
+        fprintf(stderr, "%s was saved with other SIMD pair kernels (see SIM_SIMD); the replay will drift\n",
+                load);
+    if (record && !(rec_create(&rec, record) && sim_save(snap_path, 0))) {
+        fprintf(stderr, "cannot record to %s\n", record);
+        return 1;
+    }
+    if (record) frame = 0;
+    if (replay && !(rec_open(&rec, replay) && rec_seek(&rec, frame))) {
+        fprintf(stderr, "cannot replay %s\n", replay);
+        return 1;
+    }
+    sim_checkpoint(frame);
+    long snap_bucket = sim_steps() / SNAP_EVERY;
 
-int main(void) {
     if (!app_init("Particles", W, H)) return 1;
+    sim_set_pixels(app_pixels() == APP_XBGR ? SIM_PIXELS_XBGR : SIM_PIXELS_XRGB);
+    hud_set_bgr(app_pixels() == APP_XBGR);
 
     int fbw, fbh;
     uint32_t *fb = app_framebuffer(&fbw, &fbh);
-    (void)fbw; (void)fbh;
 
-    sim_init();
+    perf_on = getenv("SIM_PERF") && perf_open();
 
     Input in = {0};
     int show_fps = 1;
     int limit_fps = 1;
+    int paused = 0;
+    int shift_alone = 0;        // SHIFT held without an arrow key so far
+
+    Camera cam;
+    camera_init(&cam);
+
+    const double step = 1.0 / SIM_HZ;
+    double acc = 0.0;
 
-    for (double last = app_time(); app_pump(&in) && !in.pressed[KEY_ESC]; last = app_time()) {
+    // app_present is only timed after the frame is on screen, so the HUD
+    // shows the previous frame's value; the same for the latency from the
+    // last step to on screen, what the pipeline's is compared with
+    HudPhase present = {"app_present", 0.0, -1.0, -1.0};
+    HudPhase latency = {"latency", 0.0, -1.0, -1.0};
+    long shown = 0;
+    double lat_sum = 0.0, lat_max = 0.0;
+
+    if (pipelined && !run_pipeline(fb, &cam)) {
+        fprintf(stderr, "cannot start the pipeline threads; running them in turn\n");
+        pipelined = 0;
+    }
+
+    for (double last = app_time(); !pipelined && app_pump(&in) && !in.pressed[KEY_ESC]; ) {
         if (in.pressed[KEY_L]) limit_fps = !limit_fps;
         if (in.pressed[KEY_F]) show_fps = !show_fps;
+        // M flips between discs and density splats, leaving the automatic choice
+        if (in.pressed[KEY_M])
+            sim_set_render(sim_render_mode() == SIM_RENDER_DENSITY ? SIM_RENDER_DISCS : SIM_RENDER_DENSITY);
+
+        double frame_start = app_time();
+        camera_update(&cam, &in, (float)(frame_start - last));
+        sim_set_view(cam.cx, cam.cy, cam.zoom);
+        acc += frame_start - last;
+        last = frame_start;
+        if (acc > MAX_STEPS * step) acc = MAX_STEPS * step;
 
-        // fixed step for teaching
-        sim_step(1.0f / 60.0f);
-        sim_render(fb);
+        Mark m0, m1, m2, m3;
+        if (show_fps) mark(&m0);
 
-        app_present(fb);
+        // A replay takes its step counts and render phase from the log rather
+        // than the wall clock, so it reproduces the recorded run exactly
+        int steps = 0;
+        float alpha = 1.0f;
+        if (replay) {
+            if (in.pressed[KEY_SPACE]) paused = !paused;
+            int arrows = in.down[KEY_LEFT] | in.down[KEY_RIGHT] | in.down[KEY_UP] | in.down[KEY_DOWN];
+            if (in.pressed[KEY_SHIFT]) shift_alone = 1;
+            if (arrows) shift_alone = 0;
+            if (in.released[KEY_SHIFT] && shift_alone && sim_rewind(sim_steps() - REWIND_STEPS, &frame)) {
+                rec_seek(&rec, frame);
+                snap_bucket = sim_steps() / SNAP_EVERY;
+            }
+            Input logged;
+            if (paused || !rec_read(&rec, &steps, &alpha, &logged)) steps = 0;
+        } else {
+            for (; acc >= step; acc -= step) steps++;
+            alpha = (float)(acc / step);
+        }
 
-        // FPS limiter can be implemented in main (sleep) or in app_present (SDL_Delay)
-        (void)show_fps;
-        (void)limit_fps;
+        sim_reset_times();
+        for (int k = 0; k < steps; k++) sim_step((float)step);
+        double stepped = app_time();
+        if (show_fps) mark(&m1);
+
+        if (record) rec_write(&rec, steps, alpha, &in);
+        if (!paused) frame++;
+        if (sim_steps() / SNAP_EVERY != snap_bucket) {
+            snap_bucket = sim_steps() / SNAP_EVERY;
+            sim_checkpoint(frame);
+        }
+
+        // Out to the window texture as it is drawn when the renderer allows
+        // it; fb keeps the trails, since locked memory is write-only
+        int pitch = fbw;
+        uint32_t *out = app_lock_frame(0, &pitch);
+        sim_render_out(fb, out, pitch, alpha);
+        if (show_fps) {
+            mark(&m2);
+
+            HudPhase phases[MAX_PHASES];
+            SysTime times[MAX_PHASES - 4];
+            int np = 0, nsys = sim_system_times(times, MAX_PHASES - 4);
+            phases[np++] = phase("sim_step", &m0, &m1);
+            for (int k = 0; k < nsys; k++)
+                phases[np++] = (HudPhase){times[k].name, times[k].seconds * 1e3, -1.0, -1.0};
+            phases[np++] = phase("sim_render", &m1, &m2);
+            phases[np++] = present;
+            phases[np++] = latency;
+            // The panel is narrower than the window, so the pitch can stand
+            // in for its width. In the texture it stays out of the trails.
+            if (out) {
+                hud_draw(out, pitch, fbh, phases, np);
+            } else {
+                int hud_w, hud_h;
+                hud_draw(fb, fbw, fbh, phases, np);
+                hud_size(np, &hud_w, &hud_h);
+                sim_render_touched(fb, 0, 0, hud_w, hud_h);
+            }
+            mark(&m2);
+        }
+
+        if (out) app_present_locked(0);
+        else app_present(fb);
+        if (show_fps) {
+            mark(&m3);
+            present = phase("app_present", &m2, &m3);
+        }
+        double lat = app_time() - stepped;
+        latency.ms = lat * 1e3;
+        shown++;
+        lat_sum += lat;
+        lat_max = fmax(lat_max, lat);
+
+        if (limit_fps) app_sleep(1.0 / RENDER_HZ - (app_time() - frame_start));
+        hud_frame(app_time() - frame_start);
     }
 
+    if (shown)
+        printf("in turn: %ld frames, last step to screen %.1f ms mean, %.1f ms worst\n",
+               shown, lat_sum / shown * 1e3, lat_max * 1e3);
+
+    SimStats st;
+    sim_get_stats(&st);
+    printf("%ld steps, %ld reorders\n", st.steps, st.reorders);
+
+    rec_close(&rec);
+    perf_close();
     app_shutdown();
     return 0;
 }
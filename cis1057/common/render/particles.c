@@ -0,0 +1,192 @@
+// particles.c
+#include "particles.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIGN 64
+
+// aligned_alloc wants a size that is a multiple of the alignment
+static void *alloc_aligned(size_t bytes) {
+    return aligned_alloc(ALIGN, (bytes + ALIGN - 1) / ALIGN * ALIGN);
+}
+
+int particles_init(Particles *p, int cap) {
+    memset(p, 0, sizeof(*p));
+    return particles_reserve(p, cap > 0 ? cap : 1);
+}
+
+void particles_free(Particles *p) {
+    for (int k = 0; k < NCOMP; k++) free(p->c[k]);
+    free(p->color);
+    free(p->id);
+    free(p->slot_of);
+    free(p->free_ids);
+    free(p->scratch);
+    free(p->keys);
+    free(p->tmp);
+    memset(p, 0, sizeof(*p));
+}
+
+// Every per-slot array is 4 bytes per particle, so one helper moves them all
+static void *regrow(void *old, int n, int cap) {
+    void *a = alloc_aligned((size_t)cap * 4);
+    if (a && n) memcpy(a, old, (size_t)n * 4);
+    return a;
+}
+
+int particles_reserve(Particles *p, int cap) {
+    if (cap <= p->cap) return 1;
+
+    void *a[NCOMP + 2];
+    int ok = 1;
+    for (int k = 0; k < NCOMP + 2; k++) {
+        void *old = k < NCOMP ? (void *)p->c[k] : k == NCOMP ? (void *)p->color : (void *)p->id;
+        ok &= (a[k] = regrow(old, p->n, cap)) != NULL;
+    }
+    void *scratch = alloc_aligned((size_t)cap * 4);
+    uint64_t *keys = malloc((size_t)cap * sizeof(uint64_t));
+    uint64_t *tmp = malloc((size_t)cap * sizeof(uint64_t));
+    if (!ok || !scratch || !keys || !tmp) {
+        for (int k = 0; k < NCOMP + 2; k++) free(a[k]);
+        free(scratch); free(keys); free(tmp);
+        return 0;
+    }
+
+    // No aligned realloc in C, so regrow() copied the live prefix by hand
+    for (int k = 0; k < NCOMP; k++) { free(p->c[k]); p->c[k] = a[k]; }
+    free(p->color); p->color = a[NCOMP];
+    free(p->id); p->id = a[NCOMP + 1];
+    free(p->scratch); p->scratch = scratch;
+    free(p->keys); p->keys = keys;
+    free(p->tmp); p->tmp = tmp;
+    p->cap = cap;
+    return 1;
+}
+
+static int reserve_handles(Particles *p, int count) {
+    if (count <= p->id_cap) return 1;
+    int cap = p->id_cap ? p->id_cap : 1024;
+    while (cap < count) cap *= 2;
+    int *slot_of = realloc(p->slot_of, (size_t)cap * sizeof(int));
+    if (!slot_of) return 0;
+    p->slot_of = slot_of;
+    int *free_ids = realloc(p->free_ids, (size_t)cap * sizeof(int));
+    if (!free_ids) return 0;
+    p->free_ids = free_ids;
+    p->id_cap = cap;
+    return 1;
+}
+
+static int new_handle(Particles *p) {
+    if (p->nfree) return p->free_ids[--p->nfree];
+    if (!reserve_handles(p, p->nids + 1)) return -1;
+    return p->nids++;
+}
+
+int particles_set_handles(Particles *p, int nids, const int *free_ids, int nfree) {
+    if (!reserve_handles(p, nids)) return 0;
+    p->nids = nids;
+    for (int h = 0; h < nids; h++) p->slot_of[h] = -1;
+    for (int i = 0; i < p->n; i++) p->slot_of[p->id[i]] = i;
+    memcpy(p->free_ids, free_ids, (size_t)nfree * sizeof(int));
+    p->nfree = nfree;
+    return 1;
+}
+
+int particles_push(Particles *p) {
+    if (p->n == p->cap && !particles_reserve(p, p->cap * 2)) return -1;
+    int h = new_handle(p);
+    if (h < 0) return -1;
+    int i = p->n++;
+    p->id[i] = h;
+    p->slot_of[h] = i;
+    return i;
+}
+
+void particles_swap_remove(Particles *p, int i) {
+    int h = p->id[i];
+    p->slot_of[h] = -1;
+    p->free_ids[p->nfree++] = h;
+
+    int last = --p->n;
+    if (i == last) return;
+    for (int k = 0; k < NCOMP; k++) p->c[k][i] = p->c[k][last];
+    p->color[i] = p->color[last];
+    p->id[i] = p->id[last];
+    p->slot_of[p->id[i]] = i;
+}
+
+int particles_find(const Particles *p, int handle) {
+    if (handle < 0 || handle >= p->nids) return -1;
+    return p->slot_of[handle];
+}
+
+// Gather src[perm[k]] into the scratch array, then swap it in
+static void *gather(Particles *p, void *src, const int *perm) {
+    uint32_t *dst = p->scratch;
+    const uint32_t *s = src;
+    for (int k = 0; k < p->n; k++) dst[k] = s[perm[k]];
+    p->scratch = src;
+    return dst;
+}
+
+void particles_permute(Particles *p, const int *perm) {
+    for (int k = 0; k < NCOMP; k++) p->c[k] = gather(p, p->c[k], perm);
+    p->color = gather(p, p->color, perm);
+    p->id = gather(p, p->id, perm);
+    for (int i = 0; i < p->n; i++) p->slot_of[p->id[i]] = i;
+}
+
+// Spread the low 16 bits of v to the even bit positions
+static inline uint32_t spread(uint32_t v) {
+    v = (v | v << 8) & 0x00FF00FFu;
+    v = (v | v << 4) & 0x0F0F0F0Fu;
+    v = (v | v << 2) & 0x33333333u;
+    v = (v | v << 1) & 0x55555555u;
+    return v;
+}
+
+static inline uint32_t quantise(float v, float scale) {
+    float q = v * scale;
+    return q <= 0.0f ? 0u : q >= 65535.0f ? 65535u : (uint32_t)q;
+}
+
+void particles_sort_morton(Particles *p, float w, float h) {
+    int n = p->n;
+    if (n < 2) return;
+
+    // Key in the high half, current slot in the low half
+    float sx = 65535.0f / w, sy = 65535.0f / h;
+    for (int i = 0; i < n; i++) {
+        uint32_t key = spread(quantise(p->c[X][i], sx)) | spread(quantise(p->c[Y][i], sy)) << 1;
+        p->keys[i] = (uint64_t)key << 32 | (uint32_t)i;
+    }
+
+    // LSD radix sort on the 32 key bits, 8 bits per pass (stable)
+    uint64_t *a = p->keys, *b = p->tmp;
+    for (int shift = 32; shift < 64; shift += 8) {
+        int count[257] = {0};
+        for (int i = 0; i < n; i++) count[(a[i] >> shift & 0xFF) + 1]++;
+        for (int d = 0; d < 256; d++) count[d + 1] += count[d];
+        for (int i = 0; i < n; i++) b[count[a[i] >> shift & 0xFF]++] = a[i];
+        uint64_t *t = a; a = b; b = t;
+    }
+
+    // Four passes leave the result back in keys; reuse tmp as the permutation
+    int *perm = (int *)p->tmp;
+    for (int k = 0; k < n; k++) perm[k] = (int)(uint32_t)a[k];
+    particles_permute(p, perm);
+}
+
+float particles_locality(const Particles *p, float dist) {
+    if (p->n < 2) return 1.0f;
+    const float *x = p->c[X], *y = p->c[Y];
+    float d2 = dist * dist;
+    int step = p->n / 4096 + 1, near = 0, total = 0;
+    for (int i = 0; i + 1 < p->n; i += step) {
+        float dx = x[i + 1] - x[i], dy = y[i + 1] - y[i];
+        near += dx * dx + dy * dy < d2;
+        total++;
+    }
+    return (float)near / (float)total;
+}
@@ -0,0 +1,67 @@
+// particles.h
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <stdint.h>
+
+// Particle components, one array each; IM is the inverse mass 1/R² the
+// pair kernels read instead of dividing per pair; PX/PY hold the position before the
+// last step so rendering can interpolate between fixed steps. NN, DT and BIN
+// drive multi-rate stepping: the nearest surface gap seen by the pair
+// passes, this sub-step's timestep (0 when idle) and the timestep bin.
+enum {X, VX, Y, VY, R, IM, PX, PY, NN, DT, BIN, NCOMP};
+
+// Structure-of-arrays particle table.
+// Live particles are always packed into [0, n); every array is 64-byte
+// aligned so loops start on a cache line and vector loads never split one.
+//
+// Slots move (swap-remove, reordering), so code outside the sim refers to a
+// particle by handle: slot_of[handle] is its current index, id[index] its
+// handle. Freed handles are recycled.
+typedef struct {
+    float *c[NCOMP];
+    uint32_t *color;
+    int *id;
+    int n, cap;
+
+    int *slot_of;           // handle -> index, -1 when free
+    int *free_ids;          // stack of free handles
+    int nfree, nids, id_cap;
+
+    void *scratch;          // reorder buffer, cap elements of 4 bytes
+    uint64_t *keys, *tmp;   // sort buffers, cap elements each
+} Particles;
+
+// Allocate room for cap particles; returns 0 on failure
+int particles_init(Particles *p, int cap);
+void particles_free(Particles *p);
+
+// Grow capacity to at least cap, keeping contents; returns 0 on failure
+int particles_reserve(Particles *p, int cap);
+
+// Append an uninitialised particle (amortised O(1)); returns its index or -1
+int particles_push(Particles *p);
+
+// Remove particle i in O(1) by moving the last particle into its slot
+void particles_swap_remove(Particles *p, int i);
+
+// Rebuild the handle table after id[0 .. n) was filled in directly (e.g. when
+// loading a snapshot); free_ids is the free-handle stack to restore
+int particles_set_handles(Particles *p, int nids, const int *free_ids, int nfree);
+
+// Current index of a handle, or -1 if it has been removed
+int particles_find(const Particles *p, int handle);
+
+// Reorder every array so that slot k holds what was in slot perm[k]
+void particles_permute(Particles *p, const int *perm);
+
+// Sort particles along a Z-order (Morton) curve of (X, Y) over a w x h
+// world so that particles close in space are close in memory. The
+// permutation it applied is left in (int *)p->tmp for mirroring elsewhere.
+void particles_sort_morton(Particles *p, float w, float h);
+
+// Fraction of a sample of consecutive slots that lie within dist of each
+// other: near 1 right after a Morton sort, decays as particles mix
+float particles_locality(const Particles *p, float dist);
+
+#endif // PARTICLES_H
@@ -0,0 +1,22 @@
+// perfctr.h
+#ifndef PERFCTR_H
+#define PERFCTR_H
+
+#include <stdint.h>
+
+// Hardware counters through Linux perf_event_open, summed over every thread
+// of the process. Unavailable (e.g. perf_event_paranoid, not Linux, VM
+// without a PMU) means perf_open returns 0 and the HUD hides the columns.
+typedef struct {
+    uint64_t cycles, instructions, llc_misses;
+} PerfSample;
+
+// Open counters on all threads that exist now: call after sim_init so the
+// job workers are included
+int perf_open(void);
+void perf_close(void);
+
+// Current totals; the difference of two samples gives the cost of a phase
+void perf_read(PerfSample *s);
+
+#endif // PERFCTR_H
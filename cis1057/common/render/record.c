@@ -0,0 +1,79 @@
+// record.c
+#include "record.h"
+#include <stdint.h>
+#include <string.h>
+
+#define REC_VERSION 1
+
+typedef struct {
+    char magic[8];          // "PSIMREC\0"
+    uint32_t version;
+    uint32_t key_count;     // KEY_COUNT of the writer
+} RecHeader;
+
+typedef struct {
+    uint32_t steps;
+    float alpha;
+    uint16_t down, pressed, released, pad;  // bit k = key k
+} RecFrame;
+
+static const char MAGIC[8] = "PSIMREC";
+
+_Static_assert(KEY_COUNT <= 16, "key bitmasks are 16 bits wide");
+
+int rec_create(Recorder *r, const char *path) {
+    r->f = fopen(path, "wb");
+    r->frames = 0;
+    if (!r->f) return 0;
+    RecHeader h = {{0}, REC_VERSION, KEY_COUNT};
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    return fwrite(&h, sizeof(h), 1, r->f) == 1;
+}
+
+int rec_open(Recorder *r, const char *path) {
+    r->f = fopen(path, "rb");
+    if (!r->f) return 0;
+    RecHeader h;
+    if (fread(&h, sizeof(h), 1, r->f) != 1 || memcmp(h.magic, MAGIC, sizeof(MAGIC))
+        || h.version != REC_VERSION || h.key_count != KEY_COUNT) {
+        rec_close(r);
+        return 0;
+    }
+    fseek(r->f, 0, SEEK_END);
+    r->frames = (ftell(r->f) - (long)sizeof(RecHeader)) / (long)sizeof(RecFrame);
+    return rec_seek(r, 0);
+}
+
+void rec_close(Recorder *r) {
+    if (r->f) fclose(r->f);
+    r->f = NULL;
+}
+
+int rec_write(Recorder *r, int steps, float alpha, const Input *in) {
+    RecFrame fr = {(uint32_t)steps, alpha, 0, 0, 0, 0};
+    for (int k = 0; k < KEY_COUNT; k++) {
+        fr.down     |= (uint16_t)(in->down[k] ? 1u << k : 0);
+        fr.pressed  |= (uint16_t)(in->pressed[k] ? 1u << k : 0);
+        fr.released |= (uint16_t)(in->released[k] ? 1u << k : 0);
+    }
+    return fwrite(&fr, sizeof(fr), 1, r->f) == 1;
+}
+
+int rec_read(Recorder *r, int *steps, float *alpha, Input *in) {
+    RecFrame fr;
+    if (fread(&fr, sizeof(fr), 1, r->f) != 1) return 0;
+    *steps = (int)fr.steps;
+    *alpha = fr.alpha;
+    memset(in, 0, sizeof(*in));
+    for (int k = 0; k < KEY_COUNT; k++) {
+        in->down[k] = fr.down >> k & 1;
+        in->pressed[k] = fr.pressed >> k & 1;
+        in->released[k] = fr.released >> k & 1;
+    }
+    return 1;
+}
+
+int rec_seek(Recorder *r, long frame) {
+    if (frame < 0 || frame > r->frames) return 0;
+    return fseek(r->f, (long)sizeof(RecHeader) + frame * (long)sizeof(RecFrame), SEEK_SET) == 0;
+}
@@ -0,0 +1,28 @@
+// record.h
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdio.h>
+#include "app.h"
+
+// Frame log for deterministic replay: for every rendered frame, how many
+// fixed sim steps ran, the render interpolation factor and the input state.
+// Together with the snapshot the run started from, this reproduces the run.
+typedef struct {
+    FILE *f;
+    long frames;            // frames in the file when reading
+} Recorder;
+
+int rec_create(Recorder *r, const char *path);  // start a new log; 0 on failure
+int rec_open(Recorder *r, const char *path);    // open a log for replay
+void rec_close(Recorder *r);
+
+int rec_write(Recorder *r, int steps, float alpha, const Input *in);
+
+// Next frame of a replay; returns 0 at the end of the log
+int rec_read(Recorder *r, int *steps, float *alpha, Input *in);
+
+// Continue a replay from the given frame
+int rec_seek(Recorder *r, long frame);
+
+#endif // RECORD_H
@@ -0,0 +1,70 @@
+// rng.h
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// xoshiro128** (Blackman & Vigna): small, fast, and its whole state fits in
+// a snapshot, so a run can be replayed exactly. Unlike rand(), each
+// generator is independent and there is no hidden global state.
+typedef struct {
+    uint32_t s[4];
+} Rng;
+
+static inline uint32_t rng_rotl(uint32_t x, int k) {
+    return x << k | x >> (32 - k);
+}
+
+// Expand a 64-bit seed into a full state with splitmix64
+static inline void rng_seed(Rng *r, uint64_t seed) {
+    for (int k = 0; k < 4; k += 2) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        r->s[k] = (uint32_t)z;
+        r->s[k + 1] = (uint32_t)(z >> 32);
+    }
+}
+
+static inline uint32_t rng_next(Rng *r) {
+    uint32_t *s = r->s;
+    uint32_t out = rng_rotl(s[1] * 5, 7) * 9;
+    uint32_t t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 11);
+    return out;
+}
+
+// Uniform integer in [0, n) by multiply-shift (no modulo bias worth noting for small n)
+static inline uint32_t rng_below(Rng *r, uint32_t n) {
+    return (uint32_t)((uint64_t)rng_next(r) * n >> 32);
+}
+
+// Uniform float in [0, 1) from the top 24 bits
+static inline float rng_float(Rng *r) {
+    return (rng_next(r) >> 8) * (1.0f / 16777216.0f);
+}
+
+// RNG_LANES interleaved xoshiro128** streams for the vector kernels: word k
+// of stream l is s[k][l]. A fill produces the same numbers at every vector
+// width, so output never depends on the CPU (see kernels.h).
+#define RNG_LANES 8
+
+typedef struct {
+    uint32_t s[4][RNG_LANES];
+} RngWide;
+
+// Lane states are drawn from one scalar generator seeded with seed
+static inline void rng_wide_seed(RngWide *w, uint64_t seed) {
+    Rng r;
+    rng_seed(&r, seed);
+    for (int l = 0; l < RNG_LANES; l++)
+        for (int k = 0; k < 4; k++) w->s[k][l] = rng_next(&r);
+}
+
+#endif // RNG_H
@@ -0,0 +1,120 @@
+// rowcheck.c
+// Accuracy / speed of the vector pair rows against the scalar ones.
+//   usage: rowcheck [n] [seed]
+// Exits 1 if a row's kicks differ from the scalar ones by more than
+// ROW_TOLERANCE of the largest kick.
+#include "kernels.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+enum {CX, CY, CVX, CVY, CR, CIM, CDT, NARR};
+
+typedef struct {
+    int n, *start, *js;
+    float *c[NARR];
+} Rows;
+
+// Every particle of the pass against the later ones within the cutoff, as
+// the grid would hand them over
+static void run(const Rows *rs, PairRow row, float *vx, float *vy, float *nn, int multirate) {
+    memcpy(vx, rs->c[CVX], rs->n * sizeof(float));
+    memcpy(vy, rs->c[CVY], rs->n * sizeof(float));
+    for (int i = 0; i < rs->n; i++) nn[i] = INFINITY;
+    PairArgs a = {rs->c[CX], rs->c[CY], vx, vy, rs->c[CR], rs->c[CIM], multirate ? rs->c[CDT] : NULL,
+                  60.0f, nn, 0x3000, 256.0f * 256.0f};
+    for (int i = 0; i < rs->n; i++) row(&a, i, rs->js + rs->start[i], rs->start[i + 1] - rs->start[i]);
+}
+
+// Largest kick difference over the largest kick, per velocity component
+static double kick_error(const Rows *rs, const float *vx, const float *vy, const float *rx, const float *ry) {
+    double err = 0.0, ref = 0.0;
+    for (int i = 0; i < rs->n; i++) {
+        double kx = rx[i] - rs->c[CVX][i], ky = ry[i] - rs->c[CVY][i];
+        ref = fmax(ref, fmax(fabs(kx), fabs(ky)));
+        err = fmax(err, fmax(fabs(vx[i] - rx[i]), fabs(vy[i] - ry[i])));
+    }
+    return ref > 0.0 ? err / ref : 0.0;
+}
+
+int main(int argc, char *argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 4000;
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+
+    // The scalar repel and collision results, then scratch
+    enum {REPEL_VX, REPEL_VY, HIT_VX, HIT_VY, VX, VY, NN, NOUT};
+    Rows rs = {n, malloc((n + 1) * sizeof(int)), NULL, {0}};
+    float *out[NOUT];
+    int ok = rs.start != NULL;
+    for (int k = 0; k < NARR; k++) ok &= (rs.c[k] = malloc(n * sizeof(float))) != NULL;
+    for (int k = 0; k < NOUT; k++) ok &= (out[k] = malloc(n * sizeof(float))) != NULL;
+    if (!ok) return 1;
+
+    // A packed box, so there are overlaps for collision as well as repel pairs
+    float side = sqrtf((float)n) * 14.0f;
+    for (int i = 0; i < n; i++) {
+        rs.c[CX][i] = side * (rand() / (float)RAND_MAX);
+        rs.c[CY][i] = side * (rand() / (float)RAND_MAX);
+        rs.c[CVX][i] = rand() % 201 - 100.0f;
+        rs.c[CVY][i] = rand() % 201 - 100.0f;
+        rs.c[CR][i] = rand() % 101 / 20.0f + 8.0f;
+        rs.c[CIM][i] = 1.0f / (rs.c[CR][i] * rs.c[CR][i]);
+        rs.c[CDT][i] = rand() & 1 ? 1.0f / 60.0f : 0.0f;    // half idle this sub-step
+    }
+    long pairs = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        pairs = 0;
+        for (int i = 0; i < n; i++) {
+            rs.start[i] = (int)pairs;
+            for (int j = i + 1; j < n; j++) {
+                float dx = rs.c[CX][j] - rs.c[CX][i], dy = rs.c[CY][j] - rs.c[CY][i];
+                if (dx * dx + dy * dy >= 256.0f * 256.0f) continue;
+                if (pass) rs.js[pairs] = j;
+                pairs++;
+            }
+        }
+        rs.start[n] = (int)pairs;
+        if (!pass && !(rs.js = malloc((pairs ? pairs : 1) * sizeof(int)))) return 1;
+    }
+    printf("n = %d, %ld pairs\n", n, pairs);
+    printf("%8s %8s %10s %10s %10s %10s\n", "level", "rates", "repel ns", "error", "collide ns", "error");
+
+    Kernels ref;
+    kernels_select(&ref, CPU_SCALAR);
+    int fail = 0;
+    for (int multirate = 0; multirate < 2; multirate++) {
+        run(&rs, ref.repel_row, out[REPEL_VX], out[REPEL_VY], out[NN], multirate);
+        run(&rs, ref.collide_row, out[HIT_VX], out[HIT_VY], out[NN], multirate);
+        for (int l = CPU_SCALAR; l <= (int)cpu_level(); l++) {
+            Kernels k;
+            kernels_select(&k, (CpuLevel)l);
+            double t0 = now();
+            run(&rs, k.repel_row, out[VX], out[VY], out[NN], multirate);
+            double repel = now() - t0;
+            double repel_err = kick_error(&rs, out[VX], out[VY], out[REPEL_VX], out[REPEL_VY]);
+            t0 = now();
+            run(&rs, k.collide_row, out[VX], out[VY], out[NN], multirate);
+            double collide = now() - t0;
+            double collide_err = kick_error(&rs, out[VX], out[VY], out[HIT_VX], out[HIT_VY]);
+            printf("%8s %8s %10.2f %10.2e %10.2f %10.2e\n", cpu_level_name((CpuLevel)l),
+                   multirate ? "multi" : "single", repel * 1e9 / (pairs ? pairs : 1), repel_err,
+                   collide * 1e9 / (pairs ? pairs : 1), collide_err);
+            fail |= repel_err > ROW_TOLERANCE || collide_err > ROW_TOLERANCE;
+        }
+    }
+    if (fail) printf("error above ROW_TOLERANCE (%.0e)\n", ROW_TOLERANCE);
+
+    for (int k = 0; k < NARR; k++) free(rs.c[k]);
+    for (int k = 0; k < NOUT; k++) free(out[k]);
+    free(rs.start);
+    free(rs.js);
+    return fail;
+}
@@ -0,0 +1,113 @@
+// schedule.c
+#include "schedule.h"
+#include "jobs.h"
+#include <stdio.h>
+#include <time.h>
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Run one system and charge the elapsed time to it
+static void run_timed(Schedule *s, int k, int lo, int hi) {
+    const System *sys = &s->sys[k];
+    long long t0 = now_ns();
+    if (sys->kind != SYS_ELEMENT) sys->run(sys->ctx);
+    else sys->range(sys->ctx, lo, hi);
+    atomic_fetch_add_explicit(&s->ns[k], now_ns() - t0, memory_order_relaxed);
+}
+
+int sched_add(Schedule *s, System sys) {
+    if (s->nsys == SCHED_MAX) return 0;
+    atomic_store(&s->ns[s->nsys], 0);
+    s->sys[s->nsys++] = sys;
+    s->nstages = 0;
+    return 1;
+}
+
+static int conflicts(const System *a, const System *b) {
+    return (a->writes & (b->reads | b->writes)) || (b->writes & a->reads);
+}
+
+// Greedy placement: each system goes into the earliest stage after every
+// earlier system it conflicts with. Element-wise systems may share a stage
+// with conflicting element-wise ones because the fused chunk loop runs them
+// in registration order.
+void sched_compile(Schedule *s) {
+    s->nstages = 0;
+    for (int k = 0; k < s->nsys; k++) {
+        int stage = 0;
+        for (int p = 0; p < k; p++) {
+            if (!conflicts(&s->sys[p], &s->sys[k])) continue;
+            int fuse = s->sys[p].kind == SYS_ELEMENT && s->sys[k].kind == SYS_ELEMENT;
+            int after = s->stage_of[p] + !fuse;
+            if (after > stage) stage = after;
+        }
+        s->stage_of[k] = stage;
+        if (stage + 1 > s->nstages) s->nstages = stage + 1;
+    }
+}
+
+// One stage is a single parallel_for: global systems take the first items,
+// element chunks the rest
+typedef struct {
+    Schedule *s;
+    int stage;
+    int globals[SCHED_MAX], nglobals;
+    int elems[SCHED_MAX], nelems;
+    int n, chunk;
+} StageRun;
+
+static void stage_job(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    StageRun *r = arg;
+    for (int t = lo; t < hi; t++) {
+        if (t < r->nglobals) {
+            run_timed(r->s, r->globals[t], 0, r->n);
+            continue;
+        }
+        int a = (t - r->nglobals) * r->chunk;
+        int b = a + r->chunk < r->n ? a + r->chunk : r->n;
+        for (int e = 0; e < r->nelems; e++) run_timed(r->s, r->elems[e], a, b);
+    }
+}
+
+void sched_run(Schedule *s, int n, int chunk) {
+    if (!s->nstages) sched_compile(s);
+
+    for (int stage = 0; stage < s->nstages; stage++) {
+        StageRun r = {.s = s, .stage = stage, .n = n, .chunk = chunk};
+        for (int k = 0; k < s->nsys; k++) {
+            if (s->stage_of[k] != stage) continue;
+            // Nothing else in the stage conflicts with it, so it can go first
+            if (s->sys[k].kind == SYS_POOLED) run_timed(s, k, 0, n);
+            else if (s->sys[k].kind == SYS_GLOBAL) r.globals[r.nglobals++] = k;
+            else r.elems[r.nelems++] = k;
+        }
+        if (!r.nglobals && !r.nelems) continue;
+
+        // A lone global system keeps the whole pool for its own parallel loops
+        if (r.nglobals == 1 && r.nelems == 0) {
+            run_timed(s, r.globals[0], 0, n);
+            continue;
+        }
+        int chunks = r.nelems ? (n + chunk - 1) / chunk : 0;
+        jobs_parallel_for(r.nglobals + chunks, 1, stage_job, &r);
+    }
+}
+
+void sched_reset_times(Schedule *s) {
+    for (int k = 0; k < SCHED_MAX; k++) atomic_store(&s->ns[k], 0);
+}
+
+void sched_dump(const Schedule *s) {
+    for (int stage = 0; stage < s->nstages; stage++) {
+        printf("stage %d:", stage);
+        for (int k = 0; k < s->nsys; k++)
+            if (s->stage_of[k] == stage)
+                printf(" %s%s", s->sys[k].name, s->sys[k].kind == SYS_ELEMENT ? "*" : "");
+        printf("\n");
+    }
+}
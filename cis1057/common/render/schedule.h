@@ -0,0 +1,53 @@
+// schedule.h
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+// Declarative system scheduler.
+// Systems are registered in program order together with the components
+// (bits of a mask, e.g. 1u << X) they read and write. sched_compile packs
+// them into stages:
+//  - element-wise systems that follow each other are fused, so every chunk
+//    of particles runs all of them back to back while it is still in cache;
+//  - systems with no read/write conflict share a stage and run concurrently,
+//    except SYS_POOLED ones: a loop nested in a job runs inline on one
+//    worker, so those run by themselves on the calling thread and keep the
+//    whole pool for their own parallel loops.
+// Results match running the systems one by one in registration order.
+
+#include <stdatomic.h>
+
+#define SCHED_MAX 16
+
+typedef enum { SYS_ELEMENT, SYS_GLOBAL, SYS_POOLED } SysKind;
+
+typedef struct {
+    const char *name;
+    SysKind kind;
+    unsigned reads, writes;
+    void (*range)(void *ctx, int lo, int hi);   // SYS_ELEMENT: process particles [lo, hi)
+    void (*run)(void *ctx);                     // SYS_GLOBAL: whole pass; SYS_POOLED: one that uses the job pool
+    void *ctx;
+} System;
+
+typedef struct {
+    System sys[SCHED_MAX];
+    int nsys;
+    int stage_of[SCHED_MAX];
+    int nstages;
+    _Atomic long long ns[SCHED_MAX];    // time spent in each system, summed over threads
+} Schedule;
+
+// Append a system; returns 0 when the schedule is full
+int sched_add(Schedule *s, System sys);
+void sched_compile(Schedule *s);
+
+// Run every stage over n particles, chunking element-wise work by chunk
+void sched_run(Schedule *s, int n, int chunk);
+
+// Zero the per-system timers
+void sched_reset_times(Schedule *s);
+
+// Print the stage plan to stdout
+void sched_dump(const Schedule *s);
+
+#endif // SCHEDULE_H
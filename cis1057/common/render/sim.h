@@ -1,11 +1,176 @@
 #ifndef SIM_H
 #define SIM_H
 
-enum {W = 2400, H = 1350};
+#include <stdint.h>
+
+enum {W = 2400, H = 1350};   // framebuffer size; the world defaults to the same
 
 // Implemented in systems.c
-void sim_init(void);
+void sim_set_threads(int n);  // worker threads for sim_step, before sim_init (<= 0: all CPUs)
+void sim_seed(unsigned seed); // RNG seed for sim_init (0: from the clock)
+void sim_init(int n);         // start with n particles (the table grows as needed)
 void sim_step(float dt);
-void sim_render(uint32_t *fb);
+void sim_render(uint32_t *fb, float alpha);  // alpha in [0,1]: blend from previous to current step
+// The same, also writing the frame to out (rows out_pitch >= W pixels
+// apart, or NULL for none) a part at a time as each is finished. out is
+// never read, so it can be write-only memory such as a locked texture; fb
+// keeps the frame the next one fades.
+void sim_render_out(uint32_t *fb, uint32_t *out, int out_pitch, float alpha);
+
+// Pipelining: sim_publish copies what sim_render draws from, alpha of the
+// way from the previous step to the current one, and sim_render_published
+// draws the newest copy, so one thread can sim_step while another renders.
+// Neither waits on the other; a copy published before the last was taken
+// replaces it, and sim_published_pending tells a publisher that would
+// rather not drop one. tag rides along untouched (a timestamp, say). Each
+// frame may go to a different W x H buffer: its trails are faded over from
+// the buffer the last one went to, which must still hold that frame (report
+// anything drawn over it with sim_render_touched). out is as for
+// sim_render_out. Single process only. sim_publish returns 0 if the copy
+// cannot be made, sim_render_published 0, with fb and out untouched, if
+// nothing new was published.
+int  sim_publish(float alpha, double tag);
+int  sim_published_pending(void);
+int  sim_render_published(uint32_t *fb, uint32_t *out, int out_pitch, double *tag);
+// Before sim_init: give sim_render_published n of the sim_set_threads
+// workers (counting the thread that renders; n < 0: a third of them) as a
+// pool of its own, so its loops and sim_step's never queue behind each
+// other. 0, the default, shares one pool.
+void sim_set_render_threads(int n);
+
+// Channel order of the pixels sim_render writes, from the top: unused, then
+// R, G, B (the default) or B, G, R
+enum {SIM_PIXELS_XRGB, SIM_PIXELS_XBGR};
+void sim_set_pixels(int layout);
+
+// How sim_render draws: discs, or a density splat (one pixel per particle,
+// brightness from the count in a pixel, hue from their mean speed) that
+// stays cheap at millions of particles. SIM_RENDER_AUTO, the default,
+// splats above SIM_DENSITY_AUTO_N particles.
+enum {SIM_RENDER_AUTO, SIM_RENDER_DISCS, SIM_RENDER_DENSITY};
+#define SIM_DENSITY_AUTO_N 250000
+void sim_set_render(int mode);
+int  sim_render_mode(void);   // DISCS or DENSITY: what sim_render (or, once used, sim_render_published) draws now
+
+// Discs leave trails: each frame fades the last one before drawing. With
+// SIM_FADE_LAZY sim_render counts, per screen tile, the frames since
+// anything was drawn there and skips tiles whose trails have faded to
+// black, so the fade costs what the active area does. That needs the
+// framebuffer to hold what the last sim_render into it left: report
+// anything drawn over it in between (a HUD, say) with sim_render_touched.
+// A few framebuffers used in turn are tracked separately.
+enum {SIM_FADE_FULL, SIM_FADE_LAZY};
+void sim_set_fade(int mode);
+void sim_render_touched(const uint32_t *fb, int x0, int y0, int x1, int y1);  // [x0, x1) x [y0, y1)
+
+// World size in pixels, before sim_init. Returns 0 for an empty world, or
+// one larger than compact storage covers while that is selected.
+int  sim_set_world(int w, int h);
+void sim_world(int *w, int *h);
+
+// Camera for sim_render: the W x H framebuffer shows the world around
+// (cx, cy) at zoom framebuffer pixels per world pixel. zoom <= 0 (the
+// default) fits the whole world. Only particles in view are drawn.
+void sim_set_view(float cx, float cy, float zoom);
+
+// Where spawned particles are placed; all of them start out heading for (cx, cy)
+typedef enum {
+    SPAWN_UNIFORM,            // anywhere in the world
+    SPAWN_RING,               // annulus of the given radius and width around (cx, cy)
+    SPAWN_GAUSSIAN,           // blob around (cx, cy) with standard deviation radius
+} SpawnKind;
+
+typedef struct {
+    SpawnKind kind;
+    float cx, cy;
+    float radius, width;
+} SpawnDist;
+
+// Particles are named by handles that stay valid while slots move around
+int  spawn(void);             // add a random particle; returns its handle or -1
+// Randomise slots [first, first + count) in parallel, appending particles
+// where the range runs past sim_count() (so first <= sim_count()). Existing
+// slots keep their handles. dist NULL means uniform over the world, heading
+// for its centre. Returns 0 on failure.
+int  spawn_batch(int first, int count, const SpawnDist *dist);
+void despawn(int handle);     // O(1): the last particle moves into the freed slot
+int  sim_find(int handle);    // current slot of a handle, or -1 once despawned
+int  sim_count(void);         // number of live particles
+
+#define SIM_MAX_BINS 8
+
+typedef struct {
+    long steps;
+    long reorders;            // Morton re-sorts of the particle arrays
+    long substeps;            // scheduler passes; equals steps at a single rate
+    int bin_count[SIM_MAX_BINS]; // particles per timestep bin right now
+    int procs;                // processes sharing the world (see sim_set_procs)
+    long dropped;             // ghosts / migrants lost to full mailboxes
+} SimStats;
+
+// Stats and system times describe the calling process; with several
+// processes that is rank 0 and its slab
+
+void sim_get_stats(SimStats *s);
+
+// Multi-rate stepping: with n > 1 bins a particle advances by dt, dt/2, ...
+// dt/2^(n-1) per sub-step depending on its speed and nearest neighbour, and
+// only particles whose bin is due drift and take kicks. 1 (the default) is a
+// single rate. Float storage only; returns 0 otherwise or when n is out of range.
+int sim_set_bins(int n);
+
+// Split the world into n vertical slabs, each simulated by its own process
+// (forked by sim_init; set this before sim_set_systems / sim_init). Particles
+// near a slab edge are mirrored to the neighbour as ghosts each step and
+// migrate when they cross. numa pins rank k to NUMA node k % nodes. Float
+// storage only, slabs at least 256 px wide (the repel cutoff), and no tree /
+// field (they need every particle). Handles, spawn / despawn and snapshots
+// are off with n > 1; spawn_batch adds on rank 0 and the particles move to
+// their owners.
+// Returns 0 if the setup is not possible; sim_init falls back to one
+// process if forking fails.
+int sim_set_procs(int n, int numa);
+
+// Which systems sim_step runs: comma-separated names, or NULL for the
+// default set. Builders of the grid / quadtree are added when a
+// selected system needs them. Returns 0 for an unknown name.
+int sim_set_systems(const char *names);
+
+typedef struct {
+    const char *name;
+    double seconds;           // summed over threads since the last reset
+} SysTime;
+
+int  sim_system_times(SysTime *out, int max);   // returns the number filled in
+void sim_reset_times(void);
+
+// Particle storage; set before sim_set_systems / sim_init. SIM_COMPACT runs
+// the element-wise systems on reduced-precision arrays (see compact.h), about
+// half the bytes per particle; only systems with a compact version can be
+// selected. SIM_COMPACT_CHECK also runs the float systems alongside so
+// sim_compact_error can compare the two. Returns 0 if the selected systems
+// cannot run compact, or the world is larger than CPOS_MAX_WORLD (compact.h).
+enum {SIM_FLOAT, SIM_COMPACT, SIM_COMPACT_CHECK};
+int sim_set_storage(int mode);
+
+typedef struct {
+    double pos_rms, pos_max;  // pixels
+    double vel_rms, vel_max;  // pixels/sec
+    double radius_max;        // pixels
+    double color_max;         // largest channel difference, 0-255
+} CompactError;
+
+int sim_compact_error(CompactError *e);   // 0 unless in SIM_COMPACT_CHECK
+
+// Snapshots (see snapshot.h for the format). A run restored from a snapshot
+// replays bit-identically given the same sequence of sim_step calls on the
+// same machine (the vector pair kernels differ slightly between CPUs).
+// frame is an opaque tag for the caller, e.g. the recorder frame to resume at.
+long sim_steps(void);                        // steps taken so far
+int  sim_save(const char *path, long frame); // returns 0 on failure
+int  sim_load(const char *path, long *frame);
+int  sim_load_exact(void);                   // 0 if it was saved with other pair kernels (no exact replay)
+void sim_checkpoint(long frame);             // push onto the in-memory ring
+int  sim_rewind(long step, long *frame);     // restore newest ring entry at or before step
 
 #endif // SIM_H
\ No newline at end of file
@@ -0,0 +1,139 @@
+// snapshot.c
+#include "snapshot.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char MAGIC[8] = {'P', 'S', 'I', 'M', 'S', 'N', 'A', 'P'};
+
+_Static_assert(sizeof(SnapHeader) == 128, "snapshot header layout changed");
+
+static size_t pad64(size_t bytes) {
+    return (bytes + 63) & ~(size_t)63;
+}
+
+// Offsets of each section; every array is 4 bytes per element
+typedef struct {
+    size_t array[NCOMP + 2];    // components, colour, handle
+    size_t free_ids, end;
+} Layout;
+
+static Layout layout(uint32_t n, uint32_t nfree) {
+    Layout l;
+    size_t off = sizeof(SnapHeader);
+    for (int k = 0; k < NCOMP + 2; k++) {
+        l.array[k] = off;
+        off += pad64((size_t)n * 4);
+    }
+    l.free_ids = off;
+    l.end = off + pad64((size_t)nfree * 4);
+    return l;
+}
+
+static void *array_of(const Particles *p, int k) {
+    return k < NCOMP ? (void *)p->c[k] : k == NCOMP ? (void *)p->color : (void *)p->id;
+}
+
+size_t snap_size(const Particles *p) {
+    return layout(p->n, p->nfree).end;
+}
+
+void snap_encode(void *buf, SnapHeader *h, const Particles *p) {
+    memcpy(h->magic, MAGIC, sizeof(MAGIC));
+    h->version = SNAP_VERSION;
+    h->ncomp = NCOMP;
+    h->n = p->n;
+    h->nids = p->nids;
+    h->nfree = p->nfree;
+
+    Layout l = layout(p->n, p->nfree);
+    memset(buf, 0, l.end);
+    memcpy(buf, h, sizeof(*h));
+    for (int k = 0; k < NCOMP + 2; k++)
+        memcpy((char *)buf + l.array[k], array_of(p, k), (size_t)p->n * 4);
+    memcpy((char *)buf + l.free_ids, p->free_ids, (size_t)p->nfree * 4);
+}
+
+int snap_decode(const void *buf, size_t size, SnapHeader *h, Particles *p) {
+    if (size < sizeof(*h)) return 0;
+    memcpy(h, buf, sizeof(*h));
+    if (memcmp(h->magic, MAGIC, sizeof(MAGIC)) || h->version != SNAP_VERSION || h->ncomp != NCOMP)
+        return 0;
+    if (h->n > INT32_MAX / 2 || h->nfree > h->nids) return 0;
+
+    Layout l = layout(h->n, h->nfree);
+    if (size < l.end || !particles_reserve(p, (int)h->n)) return 0;
+
+    p->n = (int)h->n;
+    for (int k = 0; k < NCOMP + 2; k++)
+        memcpy(array_of(p, k), (const char *)buf + l.array[k], (size_t)h->n * 4);
+    for (int i = 0; i < p->n; i++)
+        if (p->id[i] < 0 || (uint32_t)p->id[i] >= h->nids) return 0;
+    return particles_set_handles(p, (int)h->nids, (const int *)((const char *)buf + l.free_ids), (int)h->nfree);
+}
+
+int snap_write(const char *path, SnapHeader *h, const Particles *p) {
+    size_t size = snap_size(p);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return 0;
+    if (ftruncate(fd, (off_t)size)) { close(fd); return 0; }
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+    snap_encode(map, h, p);
+    int ok = msync(map, size, MS_SYNC) == 0;
+    munmap(map, size);
+    return ok;
+}
+
+int snap_read(const char *path, SnapHeader *h, Particles *p) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(SnapHeader)) { close(fd); return 0; }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+    int ok = snap_decode(map, (size_t)st.st_size, h, p);
+    munmap(map, (size_t)st.st_size);
+    return ok;
+}
+
+int snap_ring_push(SnapRing *r, SnapHeader *h, const Particles *p) {
+    int k = r->head;
+    size_t size = snap_size(p);
+    if (size > r->cap[k]) {
+        void *blob = realloc(r->blob[k], size);
+        if (!blob) return 0;
+        r->blob[k] = blob;
+        r->cap[k] = size;
+    }
+    snap_encode(r->blob[k], h, p);
+    r->size[k] = size;
+    r->step[k] = h->step;
+    r->head = (k + 1) % SNAP_RING;
+    if (r->count < SNAP_RING) r->count++;
+    return 1;
+}
+
+const void *snap_ring_find(const SnapRing *r, uint64_t step, size_t *size) {
+    // Walk from newest to oldest
+    for (int c = 1; c <= r->count; c++) {
+        int k = (r->head - c + SNAP_RING) % SNAP_RING;
+        if (r->step[k] <= step) {
+            *size = r->size[k];
+            return r->blob[k];
+        }
+    }
+    return NULL;
+}
+
+void snap_ring_free(SnapRing *r) {
+    for (int k = 0; k < SNAP_RING; k++) free(r->blob[k]);
+    memset(r, 0, sizeof(*r));
+}
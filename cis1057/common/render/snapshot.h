@@ -0,0 +1,58 @@
+// snapshot.h
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "particles.h"
+
+// Versioned binary snapshot of the simulation state.
+// Layout (native byte order): a 128-byte header, then each per-particle
+// array (NCOMP components, colour, handle) and the free-handle stack, every
+// one starting on a 64-byte boundary so a mapped file can be read in place.
+// Bump SNAP_VERSION whenever the layout or the component list changes.
+#define SNAP_VERSION 5
+#define SNAP_RING 8
+
+typedef struct {
+    char magic[8];              // "PSIMSNAP"
+    uint32_t version;
+    uint32_t ncomp;             // NCOMP of the writer
+    uint32_t n, nids, nfree;    // live particles, handles issued, free handles
+    uint32_t world_w, world_h;
+    uint32_t rng[4];            // Rng state
+    int32_t since_reorder;
+    uint64_t step;              // sim steps taken
+    uint64_t frame;             // recorder frame to resume from
+    float sorted_locality;      // after the last re-sort; 0 before the first one
+    uint32_t simd;              // CpuLevel of the writer's pair kernels
+    uint8_t reserved[48];
+} SnapHeader;
+
+// Bytes needed to encode the current state
+size_t snap_size(const Particles *p);
+
+// Encode / decode a whole snapshot in memory. Decode checks magic, version
+// and sizes and returns 0 on mismatch; p is resized as needed.
+void snap_encode(void *buf, SnapHeader *h, const Particles *p);
+int snap_decode(const void *buf, size_t size, SnapHeader *h, Particles *p);
+
+// File versions of the above, both through mmap; return 0 on failure
+int snap_write(const char *path, SnapHeader *h, const Particles *p);
+int snap_read(const char *path, SnapHeader *h, Particles *p);
+
+// Ring of the last SNAP_RING snapshots kept in memory for fast seeking
+typedef struct {
+    void *blob[SNAP_RING];
+    size_t size[SNAP_RING], cap[SNAP_RING];
+    uint64_t step[SNAP_RING];
+    int head, count;
+} SnapRing;
+
+int snap_ring_push(SnapRing *r, SnapHeader *h, const Particles *p);
+
+// Newest snapshot taken at or before step, or NULL
+const void *snap_ring_find(const SnapRing *r, uint64_t step, size_t *size);
+void snap_ring_free(SnapRing *r);
+
+#endif // SNAPSHOT_H
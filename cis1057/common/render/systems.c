@@ -2,28 +2,115 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
+#include <limits.h>
 #include <time.h>
+#include <unistd.h>
 #include "sim.h"
 #include "color.h"
+#include "particles.h"
+#include "grid.h"
+#include "kernels.h"
+#include "jobs.h"
+#include "bhtree.h"
+#include "schedule.h"
+#include "snapshot.h"
+#include "compact.h"
+#include "domain.h"
+#include "tiles.h"
+#include "handoff.h"
 
-#define N 300
+// Pair interaction ranges (pixels)
+#define R_MAX 13.0f             // largest radius spawn() can produce
+#define REPEL_CUTOFF 256.0f     // sys_repel ignores pairs further apart than this
 
-enum {X, VX, Y, VY, R};
-static float particles[5][N];
-static uint32_t color[N];
+// Particle table; grows on demand, live particles packed in [0, ps.n)
+static Particles ps;
 
-void spawn(int i) {
-    particles[R][i] = rand() % 101 / 20.0f + 8.0f;
+// World bounds in pixels, [0, world_w) x [0, world_h)
+static float world_w = W, world_h = H;
 
-    particles[X][i] = (float)(rand() % W);
-    particles[Y][i] = (float)(rand() % H);
+// All randomness in the sim comes from here, so a snapshot captures it
+static Rng rng;
 
-    float mass = particles[R][i] * particles[R][i];
-    float momentum = (rand() % 101) * (rand() % 101);
+// Broadphase, rebuilt every sim_step; cells are wide enough that every
+// interacting pair lies in the same or an adjacent cell
+static Grid grid;
+static int grid_n = -1;         // ps.n at the last grid build; -1 once slots have moved
 
-    float dx = W / 2.0f - particles[X][i];
-    float dy = H / 2.0f - particles[Y][i];
+// Quadtree for the long-range field, rebuilt every sim_step
+static BHTree tree;
+#define BH_THETA 0.5f           // opening angle: smaller is more accurate, slower
+
+// Element-wise kernels (scalar / SSE2 / AVX2), chosen in sim_init
+static Kernels kern;
+static CpuLevel kern_level;
+
+// Storage mode (SIM_FLOAT / SIM_COMPACT / SIM_COMPACT_CHECK). In the compact
+// modes the element-wise systems run on cps; ps keeps the handle table and is
+// the float staging area for spawning, reordering and snapshots. In
+// SIM_COMPACT_CHECK the float systems also run on ps as a reference.
+static int storage;
+static Compact cps;
+
+// ---- Spawning ----
+// A batch is cut into SPAWN_BLOCK-particle blocks that run as jobs. Each
+// block owns a wide generator seeded from one draw of the sim RNG plus its
+// block number, so the result does not depend on the thread count or the
+// CPU's vector width. Every particle takes SPAWN_DRAWS uniforms, draw k from
+// lane k.
+#define SPAWN_BLOCK 256
+#define SPAWN_DRAWS RNG_LANES
+#define TAU 6.28318531f
+
+typedef struct {
+    const SpawnDist *d;
+    uint64_t seed;
+    int first, count;
+} SpawnJob;
+
+static inline float clampf(float v, float lo, float hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+// Randomise the state of particle i from its draws u[0..SPAWN_DRAWS)
+static void init_particle(int i, const SpawnDist *d, const float *u) {
+    float *const *particles = ps.c;
+    float r = 8.0f + u[0] * 5.0f;
+    particles[R][i] = r;
+    particles[IM][i] = 1.0f / (r * r);
+
+    float x, y;
+    switch (d->kind) {
+    case SPAWN_RING: {
+        float a = TAU * u[1];
+        float rad = d->radius + (u[2] - 0.5f) * d->width;
+        x = d->cx + rad * cosf(a);
+        y = d->cy + rad * sinf(a);
+        break;
+    }
+    case SPAWN_GAUSSIAN: {
+        // Box-Muller; 1 - u is in (0, 1] so the log is finite
+        float a = TAU * u[2];
+        float rad = d->radius * sqrtf(-2.0f * logf(1.0f - u[1]));
+        x = d->cx + rad * cosf(a);
+        y = d->cy + rad * sinf(a);
+        break;
+    }
+    default:
+        x = u[1] * world_w;
+        y = u[2] * world_h;
+        break;
+    }
+    particles[X][i] = x = clampf(x, 0.0f, world_w);
+    particles[Y][i] = y = clampf(y, 0.0f, world_h);
+
+    // Head for the centre of the distribution
+    float mass = r * r;
+    float momentum = (u[3] * 100.0f) * (u[4] * 100.0f);
+    float dx = d->cx - x;
+    float dy = d->cy - y;
     float dist = sqrtf(dx * dx + dy * dy);
     float speed = momentum / mass;
 
@@ -35,151 +122,1506 @@ void spawn(int i) {
         particles[VY][i] = 0.0f;
     }
 
-    color[i] = random_color();
-}
+    particles[PX][i] = x;
+    particles[PY][i] = y;
+    particles[NN][i] = INFINITY;
+    particles[DT][i] = 0.0f;
+    particles[BIN][i] = 0.0f;
 
-// Initialize particle table
-void sim_init(void) {
-    srand(time(NULL));
-    for (int i = 0; i < N; i++) spawn(i);
+    ps.color[i] = random_color(u[5], u[6], u[7]);
 }
 
-static void sys_integrate(float dt) {
-    for (int i = 0; i < N; i++) {
-        particles[X][i] += particles[VX][i] * dt;
-        particles[Y][i] += particles[VY][i] * dt;
+static void spawn_blocks(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    const SpawnJob *job = arg;
+    float u[SPAWN_BLOCK * SPAWN_DRAWS];
+    for (int b = lo; b < hi; b++) {
+        int i0 = b * SPAWN_BLOCK;
+        int m = job->count - i0 < SPAWN_BLOCK ? job->count - i0 : SPAWN_BLOCK;
+        RngWide w;
+        rng_wide_seed(&w, job->seed + (uint64_t)b);
+        kern.uniform(&w, u, m * SPAWN_DRAWS);
+        for (int k = 0; k < m; k++) init_particle(job->first + i0 + k, job->d, u + k * SPAWN_DRAWS);
+        if (storage != SIM_FLOAT) compact_pack(&cps, &ps, job->first + i0, job->first + i0 + m);
     }
 }
 
-static void sys_wrap() {
-    for (int i = 0; i < N; i++) {
-        if (particles[X][i] < 0) {
-            particles[X][i] += W;
-        } else if (particles[X][i] > W) {
-            particles[X][i] -= W;
-        }
-        if (particles[Y][i] < 0) {
-            particles[Y][i] += H;
-        } else if (particles[Y][i] > H) {
-            particles[Y][i] -= H;
+int spawn_batch(int first, int count, const SpawnDist *dist) {
+    if (first < 0 || first > ps.n || count < 0) return 0;
+    SpawnDist uniform = {SPAWN_UNIFORM, 0.5f * world_w, 0.5f * world_h, 0.0f, 0.0f};
+    if (!dist) dist = &uniform;
+
+    // Slots past the end are new particles with fresh handles
+    int end = first + count, n = ps.n;
+    if (end > ps.n && !particles_reserve(&ps, end)) return 0;
+    while (ps.n < end)
+        if (particles_push(&ps) < 0) return 0;
+    if (storage != SIM_FLOAT && !compact_reserve(&cps, ps.cap, n)) return 0;
+
+    grid_n = -1;
+    // Two draws in one expression would be unsequenced; keep their order fixed
+    uint64_t hi = rng_next(&rng);
+    uint64_t lo = rng_next(&rng);
+    SpawnJob job = {dist, hi << 32 | lo, first, count};
+    jobs_parallel_for((count + SPAWN_BLOCK - 1) / SPAWN_BLOCK, 1, spawn_blocks, &job);
+    return 1;
+}
+
+// Handles belong to one process and do not survive a migration, so with
+// several processes there are none to hand out
+static Domain dom;              // nprocs 0 or 1: everything runs in this process
+
+int spawn(void) {
+    if (dom.nprocs > 1) return -1;
+    int i = ps.n;
+    if (!spawn_batch(i, 1, NULL)) return -1;
+    return ps.id[i];
+}
+
+void despawn(int handle) {
+    if (dom.nprocs > 1) return;
+    int i = particles_find(&ps, handle);
+    if (i < 0) return;
+    if (storage != SIM_FLOAT) compact_move(&cps, i, ps.n - 1);
+    particles_swap_remove(&ps, i);
+    grid_n = -1;
+}
+
+int sim_find(int handle) {
+    return dom.nprocs > 1 ? -1 : particles_find(&ps, handle);
+}
+
+int sim_count(void) {
+    return dom.nprocs > 1 ? (int)domain_count(&dom) : ps.n;
+}
+
+// Element-wise passes are split into chunks of this many particles
+// (4096 * 10 floats = 160 KB, so a fused chunk stays in L2)
+#define CHUNK 4096
+
+// Per-step parameters read by the scheduled systems; set by sim_step
+static struct {
+    float dt, inv_dt, e, G, strength;
+    uint32_t tick;          // step number, seeds the compact rounding dither
+    int sub;                // sub-step within the step (multi-rate only)
+    _Atomic int maxbin;     // finest bin in use this step
+} step;
+
+// ---- Multi-rate stepping ----
+// With bins > 1 each particle advances by dt / 2^b, where its bin b is picked
+// at the start of every step so that per sub-step it moves at most BIN_ETA
+// of its radius plus the gap to its nearest neighbour. A step then runs
+// 2^(finest bin used) sub-steps; bin b is active on every 2^(bins-1-b)-th
+// of the 2^(bins-1) possible ones, and only active particles drift and
+// receive kicks. Bins change only at step boundaries, where all of them are
+// in sync.
+#define BIN_ETA 0.5f
+
+static int bins = 1;
+
+static void sys_timestep(void *ctx, int lo, int hi) {
+    (void)ctx;
+    float *const *particles = ps.c;
+    int nsub = 1 << (bins - 1);
+    if (step.sub == 0) {
+        int maxbin = 0;
+        for (int i = lo; i < hi; i++) {
+            float v = sqrtf(particles[VX][i] * particles[VX][i] + particles[VY][i] * particles[VY][i]);
+            float t = v > 0.0f ? BIN_ETA * (particles[NN][i] + particles[R][i]) / v : INFINITY;
+            int b = 0;
+            for (float db = step.dt; b < bins - 1 && db > t; db *= 0.5f) b++;
+            particles[BIN][i] = (float)b;
+            particles[NN][i] = INFINITY;   // measured afresh during this step
+            if (b > maxbin) maxbin = b;
         }
+        int m = atomic_load(&step.maxbin);
+        while (m < maxbin && !atomic_compare_exchange_weak(&step.maxbin, &m, maxbin)) {}
+    }
+    for (int i = lo; i < hi; i++) {
+        int b = (int)particles[BIN][i];
+        int active = (step.sub & ((nsub >> b) - 1)) == 0;
+        particles[DT][i] = active ? step.dt / (float)(1 << b) : 0.0f;
     }
 }
 
-static void sys_bounce(float e) {
-    for (int i = 0; i < N; i++) {
-        if (particles[X][i] < particles[R][i]) {
-            if (particles[VX][i] < 0) particles[VX][i] *= -e;
-        } else if (particles[X][i] > W - particles[R][i]) {
-            if (particles[VX][i] > 0) particles[VX][i] *= -e;
-        }
-        if (particles[Y][i] < particles[R][i]) {
-            if (particles[VY][i] < 0) particles[VY][i] *= -e;
-        } else if (particles[Y][i] > H - particles[R][i]) {
-            if (particles[VY][i] > 0) particles[VY][i] *= -e;
+// Element-wise systems: each handles particles [lo, hi) so the scheduler can
+// fuse them into one chunked pass
+
+// Keep the pre-step position for render interpolation
+static void sys_remember(void *ctx, int lo, int hi) {
+    (void)ctx;
+    if (step.sub) return;
+    memcpy(ps.c[PX] + lo, ps.c[X] + lo, (size_t)(hi - lo) * sizeof(float));
+    memcpy(ps.c[PY] + lo, ps.c[Y] + lo, (size_t)(hi - lo) * sizeof(float));
+}
+
+static void sys_integrate(void *ctx, int lo, int hi) {
+    (void)ctx;
+    if (bins > 1) {
+        kern.integrate_dt(ps.c[X] + lo, ps.c[Y] + lo, ps.c[VX] + lo, ps.c[VY] + lo, ps.c[DT] + lo, hi - lo);
+        return;
+    }
+    kern.integrate(ps.c[X] + lo, ps.c[Y] + lo, ps.c[VX] + lo, ps.c[VY] + lo, hi - lo, step.dt);
+}
+
+static void sys_wrap(void *ctx, int lo, int hi) {
+    (void)ctx;
+    kern.wrap(ps.c[X] + lo, ps.c[Y] + lo, hi - lo, world_w, world_h);
+}
+
+static void sys_bounce(void *ctx, int lo, int hi) {
+    (void)ctx;
+    kern.bounce(ps.c[X] + lo, ps.c[Y] + lo, ps.c[VX] + lo, ps.c[VY] + lo, ps.c[R] + lo,
+                hi - lo, world_w, world_h, step.e);
+}
+
+// The same over compact storage
+static void sys_remember16(void *ctx, int lo, int hi) {
+    (void)ctx;
+    memcpy(cps.px + lo, cps.x + lo, (size_t)(hi - lo) * sizeof(uint16_t));
+    memcpy(cps.py + lo, cps.y + lo, (size_t)(hi - lo) * sizeof(uint16_t));
+}
+
+static void sys_integrate16(void *ctx, int lo, int hi) {
+    (void)ctx;
+    kern.cintegrate(cps.x + lo, cps.y + lo, cps.vx + lo, cps.vy + lo, hi - lo, step.dt,
+                    step.tick * 0x9E3779B9u + (uint32_t)lo);
+}
+
+static void sys_wrap16(void *ctx, int lo, int hi) {
+    (void)ctx;
+    kern.cwrap(cps.x + lo, cps.y + lo, hi - lo, world_w, world_h);
+}
+
+static void sys_bounce16(void *ctx, int lo, int hi) {
+    (void)ctx;
+    kern.cbounce(cps.x + lo, cps.y + lo, cps.vx + lo, cps.vy + lo, cps.r + lo, hi - lo, world_w, world_h, step.e);
+}
+
+// Run row(i, ...) for the particles in cell (cx, cy) over the rest of the
+// cell and the forward stencil cells
+static void pair_cell(int cx, int cy, PairRow row, const PairArgs *args) {
+    int c = cx + cy * grid.cols;
+    for (int a = grid.start[c]; a < grid.start[c + 1]; a++) {
+        int i = grid.items[a];
+        row(args, i, grid.items + a + 1, grid.start[c + 1] - a - 1);
+        for (int s = 0; s < 4; s++) {
+            int nx = cx + GRID_STENCIL[s][0], ny = cy + GRID_STENCIL[s][1];
+            if (nx < 0 || nx >= grid.cols || ny >= grid.rows) continue;
+            int nc = nx + ny * grid.cols;
+            row(args, i, grid.items + grid.start[nc], grid.start[nc + 1] - grid.start[nc]);
         }
     }
 }
 
-static void sys_collision() {
-    for (int i = 0; i < N; i++) {
-        float ri2 = particles[R][i] * particles[R][i];
-        for (int j = i + 1; j < N; j++) {
-            float dx = particles[X][j] - particles[X][i];
-            float dy = particles[Y][j] - particles[Y][i];
-            float d2 = dx*dx + dy*dy;
-            float rj2 = particles[R][j] * particles[R][j];
-            float dr2 = ri2 + 2 * particles[R][i] * particles[R][j] + rj2;
-
-            if (d2 < dr2 && d2 > 0.0f) {
-                float dist = sqrtf(d2);
-
-                float nx = dx / dist;
-                float ny = dy / dist;
-
-                float dvx = particles[VX][i] - particles[VX][j];
-                float dvy = particles[VY][i] - particles[VY][j];
-                float dvn = dvx*nx + dvy*ny;
-
-                if (dvn > 0) {
-                    // Mass proportional to r² (area); π cancels
-                    float mi = ri2;
-                    float mj = rj2;
-                    float inv_mass_sum = 1.0f / (mi + mj);
-
-                    // Impulse scalar for elastic collision:
-                    //   j = 2 * mi * mj / (mi + mj) * dvn
-                    // Δvi = -j/mi = -2 * mj / (mi + mj) * dvn
-                    // Δvj = +j/mj = +2 * mi / (mi + mj) * dvn
-                    float fi = 2.0f * mj * inv_mass_sum * dvn;
-                    float fj = 2.0f * mi * inv_mass_sum * dvn;
-
-                    particles[VX][i] -= fi * nx;
-                    particles[VY][i] -= fi * ny;
-                    particles[VX][j] += fj * nx;
-                    particles[VY][j] += fj * ny;
-                }
-            }
+// Cell colouring: a cell and its forward stencil span 3 columns and 2 rows,
+// so cells with equal (cx % 3, cy % 2) never touch the same particles and
+// can run in parallel. Colours run one after another in a fixed order, which
+// keeps results identical for any thread count.
+#define COLOR_COLS 3
+#define COLOR_ROWS 2
+
+typedef struct {
+    PairRow row;
+    PairArgs args;
+    int ox, oy;     // colour being processed
+    int ccols;      // cells of this colour per row
+} PairPass;
+
+// On multi-rate sub-steps where only some bins are due, cells whose pairs
+// all have both ends idle are skipped outright. Pairs belong to the cell of
+// their first particle and reach into the forward stencil, so a cell can be
+// skipped when neither it nor its stencil holds an active particle.
+static uint8_t *cell_active;
+static int cell_cap, skip_idle;
+
+static void mark_active_cells(void) {
+    int ncells = grid.cols * grid.rows;
+    if (ncells > cell_cap) {
+        uint8_t *a = realloc(cell_active, (size_t)ncells);
+        if (!a) { skip_idle = 0; return; }
+        cell_active = a;
+        cell_cap = ncells;
+    }
+    memset(cell_active, 0, (size_t)ncells);
+    const float *dt = ps.c[DT];
+    for (int i = 0; i < ps.n; i++)
+        if (dt[i] != 0.0f) cell_active[grid.cell_of[i]] = 1;
+}
+
+static int cell_due(int cx, int cy) {
+    if (cell_active[cx + cy * grid.cols]) return 1;
+    for (int s = 0; s < 4; s++) {
+        int nx = cx + GRID_STENCIL[s][0], ny = cy + GRID_STENCIL[s][1];
+        if (nx >= 0 && nx < grid.cols && ny < grid.rows && cell_active[nx + ny * grid.cols]) return 1;
+    }
+    return 0;
+}
+
+static void pair_job(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    PairPass *p = arg;
+    for (int t = lo; t < hi; t++) {
+        int cx = p->ox + t % p->ccols * COLOR_COLS;
+        int cy = p->oy + t / p->ccols * COLOR_ROWS;
+        if (skip_idle && !cell_due(cx, cy)) continue;
+        pair_cell(cx, cy, p->row, &p->args);
+    }
+}
+
+// Run a pair kernel once over every particle pair in the same or adjacent
+// cells. Pairs where both particles are idle this multi-rate sub-step are
+// skipped, and each one's nearest gap is recorded for the next choice of bins.
+static void for_each_pair(PairRow row) {
+    if (grid_n != ps.n) return;     // no grid this step (it could not grow)
+    // Every bin is due on sub-step 0
+    skip_idle = bins > 1 && step.sub > 0;
+    if (skip_idle) mark_active_cells();
+    float *const *particles = ps.c;
+    PairPass p = {row, {particles[X], particles[Y], particles[VX], particles[VY], particles[R], particles[IM],
+                        bins > 1 ? particles[DT] : NULL, step.inv_dt, bins > 1 ? particles[NN] : NULL,
+                        step.strength, REPEL_CUTOFF * REPEL_CUTOFF}, 0, 0, 0};
+    for (p.oy = 0; p.oy < COLOR_ROWS; p.oy++) {
+        for (p.ox = 0; p.ox < COLOR_COLS; p.ox++) {
+            if (p.ox >= grid.cols || p.oy >= grid.rows) continue;
+            p.ccols = (grid.cols - p.ox + COLOR_COLS - 1) / COLOR_COLS;
+            int crows = (grid.rows - p.oy + COLOR_ROWS - 1) / COLOR_ROWS;
+            jobs_parallel_for(p.ccols * crows, 1, pair_job, &p);
         }
     }
 }
 
-static void sys_repel(float strength) {
-    for (int i = 0; i < N; i++) {
-        for (int j = i + 1; j < N; j++) {
-            float dx = particles[X][j] - particles[X][i];
-            float dy = particles[Y][j] - particles[Y][i];
-            float d2 = dx * dx + dy * dy;
+static void sys_collision(void *ctx) {
+    (void)ctx;
+    for_each_pair(kern.collide_row);
+}
+
+static void sys_repel(void *ctx) {
+    (void)ctx;
+    for_each_pair(kern.repel_row);
+}
 
-            if (d2 > 0.0f && d2 < 65536.0f) {
-                float dist = sqrtf(d2);
-                float gap = dist - particles[R][i] - particles[R][j];
-                if (gap < 0.0f) gap = 0.0f;
-                float gap2 = gap * gap + 1.0f; // +1 to avoid singularity at contact
+static void sys_grid(void *ctx) {
+    (void)ctx;
+    grid_n = grid_build(&grid, ps.c[X], ps.c[Y], ps.n) ? ps.n : -1;
+}
 
-                float f = strength / gap2;
-                float fx = (dx / dist) * f;
-                float fy = (dy / dist) * f;
+// Multi-rate steps reuse the step's first tree: the field is smooth, and
+// only the few fast particles move much within a step
+static void sys_tree(void *ctx) {
+    (void)ctx;
+    if (step.sub) return;
+    bh_build(&tree, ps.c[X], ps.c[Y], ps.c[R], ps.n);
+}
+
+// Gather form: each particle only writes its own velocity, so chunks are
+// independent and the result does not depend on the thread count
+static void field_job(void *arg, int lo, int hi, int worker) {
+    (void)arg; (void)worker;
+    float *const *particles = ps.c;
+    for (int i = lo; i < hi; i++) {
+        float dt = bins > 1 ? particles[DT][i] : step.dt;
+        if (dt == 0.0f) continue;
+        float ax, ay;
+        bh_accel(&tree, particles[X][i], particles[Y][i], i, BH_THETA, step.G, R_MAX * R_MAX, &ax, &ay);
+        particles[VX][i] += ax * dt;
+        particles[VY][i] += ay * dt;
+    }
+}
+
+// Long-range mass-proportional field with no cutoff (G > 0 attracts), O(N log N)
+static void sys_field(void *ctx) {
+    (void)ctx;
+    jobs_parallel_for(ps.n, 256, field_job, NULL);
+}
 
-                float mi_inv = 1.0f / (particles[R][i] * particles[R][i]);
-                float mj_inv = 1.0f / (particles[R][j] * particles[R][j]);
+// Component sets for the scheduler; the grid and tree count as components
+// too so their builds are ordered before the systems that query them, and
+// the compact arrays are components of their own
+enum {GRID = NCOMP, TREE, CPOS, CVEL, CPREV, CRAD};
+#define C(k) (1u << (k))
 
-                particles[VX][i] -= fx * mi_inv;
-                particles[VY][i] -= fy * mi_inv;
-                particles[VX][j] += fx * mj_inv;
-                particles[VY][j] += fy * mj_inv;
+static Schedule schedule;
+
+// Every system the sim knows, in program order; `on` marks the default set.
+// `compact` is the version for compact storage, if there is one. The field
+// (Barnes-Hut attraction, no cutoff) changes the physics, so it is opt-in;
+// bhcheck compares it with the direct sum.
+static const struct {
+    System sys;
+    System compact;
+    int on;
+} systems[] = {
+    {{"timestep",   SYS_ELEMENT, C(VX) | C(VY) | C(R) | C(NN) | C(BIN), C(DT) | C(NN) | C(BIN), sys_timestep, NULL, NULL}, {0}, 0},
+    {{"remember",   SYS_ELEMENT, C(X) | C(Y), C(PX) | C(PY), sys_remember, NULL, NULL},
+     {"remember16", SYS_ELEMENT, C(CPOS), C(CPREV), sys_remember16, NULL, NULL}, 1},
+    {{"integrate",  SYS_ELEMENT, C(X) | C(Y) | C(VX) | C(VY) | C(DT), C(X) | C(Y), sys_integrate, NULL, NULL},
+     {"integrate16", SYS_ELEMENT, C(CPOS) | C(CVEL), C(CPOS), sys_integrate16, NULL, NULL}, 1},
+    {{"wrap",       SYS_ELEMENT, C(X) | C(Y), C(X) | C(Y), sys_wrap, NULL, NULL},
+     {"wrap16",     SYS_ELEMENT, C(CPOS), C(CPOS), sys_wrap16, NULL, NULL}, 0},
+    {{"bounce",     SYS_ELEMENT, C(X) | C(Y) | C(R) | C(VX) | C(VY), C(VX) | C(VY), sys_bounce, NULL, NULL},
+     {"bounce16",   SYS_ELEMENT, C(CPOS) | C(CRAD) | C(CVEL), C(CVEL), sys_bounce16, NULL, NULL}, 1},
+    {{"grid",       SYS_POOLED, C(X) | C(Y), C(GRID), NULL, sys_grid, NULL}, {0}, 1},
+    {{"repel",      SYS_POOLED, C(X) | C(Y) | C(R) | C(IM) | C(VX) | C(VY) | C(DT) | C(GRID), C(VX) | C(VY) | C(NN), NULL, sys_repel, NULL}, {0}, 1},
+    {{"collision",  SYS_POOLED, C(X) | C(Y) | C(R) | C(VX) | C(VY) | C(DT) | C(GRID), C(VX) | C(VY) | C(NN), NULL, sys_collision, NULL}, {0}, 0},
+    {{"tree",       SYS_GLOBAL, C(X) | C(Y) | C(R), C(TREE), NULL, sys_tree, NULL}, {0}, 0},
+    {{"field",      SYS_POOLED, C(X) | C(Y) | C(VX) | C(VY) | C(DT) | C(TREE), C(VX) | C(VY), NULL, sys_field, NULL}, {0}, 0},
+};
+#define NSYSTEMS (int)(sizeof(systems) / sizeof(systems[0]))
+
+static int enabled[NSYSTEMS];
+
+// Registration order is program order; see schedule.h for how it is packed.
+// Builders of the grid / tree are pulled in by whatever reads
+// them, and so is the timestep system once there is more than one bin.
+static void build_schedule(void) {
+    unsigned needed = 0, derived = ~(C(NCOMP) - 1) | (bins > 1 ? C(DT) : 0);
+    for (int k = 0; k < NSYSTEMS; k++)
+        if (enabled[k]) needed |= systems[k].sys.reads & derived;
+
+    schedule.nsys = 0;
+    for (int k = 0; k < NSYSTEMS; k++) {
+        if (!enabled[k] && !(systems[k].sys.writes & needed)) continue;
+        if (storage != SIM_COMPACT) sched_add(&schedule, systems[k].sys);
+        if (storage != SIM_FLOAT) sched_add(&schedule, systems[k].compact);
+    }
+    sched_compile(&schedule);
+}
+
+// ---- Domain decomposition ----
+// With sim_set_procs(n > 1), sim_init forks n - 1 more processes, and each
+// simulates one vertical slab of the world (see domain.h). Every step
+// starts by handing the particles that left a slab to their new owner.
+// Then each rank copies its particles within HALO of an edge to the
+// neighbour across it as ghosts: they take part in the pair passes and are
+// dropped after the step, so each side of a boundary pair kicks only its
+// own particle. The quadtree needs every particle, so the systems that
+// build or read it cannot run.
+#define HALO REPEL_CUTOFF
+
+static int sim_nprocs = 1, sim_numa;
+static int ghosts;              // ghost particles at the end of the table
+static long dropped;            // particles that did not fit a mailbox or the table
+
+static int uses_tree(int k) {
+    return ((systems[k].sys.reads | systems[k].sys.writes) & C(TREE)) != 0;
+}
+
+static int procs_ok(const int *want, int nprocs) {
+    for (int k = 0; k < NSYSTEMS; k++)
+        if (want[k] && nprocs > 1 && uses_tree(k)) return 0;
+    return 1;
+}
+
+int sim_set_procs(int n, int numa) {
+    if (n < 1 || n > DOMAIN_MAX || (n > 1 && storage != SIM_FLOAT) || world_w / n < HALO) return 0;
+    if (schedule.nsys && !procs_ok(enabled, n)) return 0;
+    sim_nprocs = n;
+    sim_numa = numa;
+    return 1;
+}
+
+// Append count received particles; returns how many fit
+static int take(const DomainParticle *m, int count) {
+    for (int k = 0; k < count; k++) {
+        int i = particles_push(&ps);
+        if (i < 0) return k;
+        for (int c = 0; c < NCOMP; c++) ps.c[c][i] = m[k].c[c];
+        ps.color[i] = m[k].color;
+    }
+    return count;
+}
+
+// Particles a full mailbox turns away stay put and try again next step
+static void migrate(void) {
+    domain_clear(&dom);
+    // Walking down, a swap-remove only moves in a particle already checked
+    for (int i = ps.n - 1; i >= 0; i--) {
+        int dst = domain_slab(&dom, ps.c[X][i]);
+        if (dst != dom.rank && domain_send(&dom, dst, &ps, i)) particles_swap_remove(&ps, i);
+    }
+    domain_sync(&dom);
+    for (int src = 0; src < dom.nprocs; src++) {
+        const DomainParticle *m;
+        int count = domain_recv(&dom, src, &m);
+        dropped += count - take(m, count);
+    }
+    domain_set_count(&dom, ps.n);
+    domain_sync(&dom);
+    grid_n = -1;
+}
+
+static void add_ghosts(void) {
+    domain_clear(&dom);
+    float x0 = dom.rank * dom.slab, x1 = x0 + dom.slab;
+    for (int i = 0; i < ps.n; i++) {
+        float x = ps.c[X][i];
+        if (dom.rank > 0 && x < x0 + HALO && !domain_send(&dom, dom.rank - 1, &ps, i)) dropped++;
+        if (dom.rank < dom.nprocs - 1 && x >= x1 - HALO && !domain_send(&dom, dom.rank + 1, &ps, i)) dropped++;
+    }
+    domain_sync(&dom);
+    int n = ps.n;
+    for (int src = dom.rank - 1; src <= dom.rank + 1; src += 2) {
+        if (src < 0 || src >= dom.nprocs) continue;
+        const DomainParticle *m;
+        int count = domain_recv(&dom, src, &m);
+        dropped += count - take(m, count);
+    }
+    ghosts = ps.n - n;
+    domain_sync(&dom);
+}
+
+static void drop_ghosts(void) {
+    for (; ghosts > 0; ghosts--) particles_swap_remove(&ps, ps.n - 1);
+    grid_n = -1;
+}
+
+static void stop_domain(void) {
+    domain_stop(&dom);
+}
+
+static void serve(void);
+
+// Compact storage only runs systems that have a compact version
+static int storage_ok(const int *want, int mode) {
+    for (int k = 0; k < NSYSTEMS; k++)
+        if (want[k] && mode != SIM_FLOAT && !systems[k].compact.name) return 0;
+    return 1;
+}
+
+int sim_set_systems(const char *names) {
+    int want[NSYSTEMS] = {0};
+    for (int k = 0; k < NSYSTEMS; k++)
+        want[k] = names ? 0 : systems[k].on && (storage == SIM_FLOAT || systems[k].compact.name) &&
+                              (sim_nprocs == 1 || !uses_tree(k));
+
+    // Comma-separated list of system names
+    for (const char *p = names; p && *p; ) {
+        size_t len = strcspn(p, ",");
+        int found = 0;
+        for (int k = 0; k < NSYSTEMS; k++) {
+            if (strlen(systems[k].sys.name) == len && strncmp(p, systems[k].sys.name, len) == 0) {
+                want[k] = found = 1;
             }
         }
+        if (!found && len) return 0;
+        p += len + (p[len] == ',');
+    }
+    if (!storage_ok(want, storage) || !procs_ok(want, sim_nprocs)) return 0;
+
+    memcpy(enabled, want, sizeof(enabled));
+    build_schedule();
+    return 1;
+}
+
+static int world_fits(int mode, float w, float h) {
+    return mode == SIM_FLOAT || (w <= CPOS_MAX_WORLD && h <= CPOS_MAX_WORLD);
+}
+
+int sim_set_storage(int mode) {
+    if (mode != SIM_FLOAT && (bins > 1 || sim_nprocs > 1)) return 0;
+    if (!world_fits(mode, world_w, world_h)) return 0;
+    if (schedule.nsys && !storage_ok(enabled, mode)) return 0;
+    storage = mode;
+    if (schedule.nsys) build_schedule();
+    return 1;
+}
+
+int sim_set_world(int w, int h) {
+    if (w <= 0 || h <= 0 || !world_fits(storage, (float)w, (float)h)) return 0;
+    if ((float)w / sim_nprocs < HALO) return 0;
+    world_w = (float)w;
+    world_h = (float)h;
+    return 1;
+}
+
+void sim_world(int *w, int *h) {
+    *w = (int)world_w;
+    *h = (int)world_h;
+}
+
+int sim_set_bins(int n) {
+    if (n < 1 || n > SIM_MAX_BINS || (n > 1 && storage != SIM_FLOAT)) return 0;
+    bins = n;
+    if (schedule.nsys) build_schedule();
+    return 1;
+}
+
+int sim_compact_error(CompactError *e) {
+    memset(e, 0, sizeof(*e));
+    if (storage != SIM_COMPACT_CHECK) return 0;
+    float *const *f = ps.c;
+    for (int i = 0; i < ps.n; i++) {
+        double dx = cpos_unpack(cps.x[i]) - f[X][i], dy = cpos_unpack(cps.y[i]) - f[Y][i];
+        double dvx = half_unpack(cps.vx[i]) - f[VX][i], dvy = half_unpack(cps.vy[i]) - f[VY][i];
+        double dp = dx * dx + dy * dy, dv = dvx * dvx + dvy * dvy;
+        e->pos_rms += dp;
+        e->vel_rms += dv;
+        e->pos_max = fmax(e->pos_max, sqrt(dp));
+        e->vel_max = fmax(e->vel_max, sqrt(dv));
+        e->radius_max = fmax(e->radius_max, fabs(crad_unpack(cps.r[i]) - f[R][i]));
+        uint32_t a = compact_color(cps.col[i]), b = ps.color[i];
+        for (int ch = 0; ch < 24; ch += 8)
+            e->color_max = fmax(e->color_max, abs((int)(a >> ch & 0xFF) - (int)(b >> ch & 0xFF)));
+    }
+    if (ps.n) {
+        e->pos_rms = sqrt(e->pos_rms / ps.n);
+        e->vel_rms = sqrt(e->vel_rms / ps.n);
+    }
+    return 1;
+}
+
+int sim_system_times(SysTime *out, int max) {
+    int k = 0;
+    for (; k < schedule.nsys && k < max; k++) {
+        out[k].name = schedule.sys[k].name;
+        out[k].seconds = atomic_load(&schedule.ns[k]) * 1e-9;
     }
+    return k;
+}
+
+void sim_reset_times(void) {
+    sched_reset_times(&schedule);
+}
+
+// Worker threads for sim_step (<= 0: one per CPU); call before sim_init
+static int sim_nthreads = 0;
+
+void sim_set_threads(int nthreads) {
+    sim_nthreads = nthreads;
+}
+
+// Workers taken from those for sim_render_published (see sim.h), and
+// their jobs pool; pool 0 is sim_step's
+static int sim_nrender = 0;
+static int render_pool = 0;
+
+void sim_set_render_threads(int nthreads) {
+    sim_nrender = nthreads;
+}
+
+// RNG seed for sim_init; 0 seeds from the clock
+static unsigned sim_seed_value = 0;
+
+void sim_seed(unsigned seed) {
+    sim_seed_value = seed;
+}
+
+// Initialize particle table with n live particles
+void sim_init(int n) {
+    // Fork before any threads exist. Each rank spawns its share anywhere in
+    // the world; the first step hands them to their owners. Threads are
+    // shared out between the ranks.
+    int threads = sim_nthreads;
+    if (sim_nprocs > 1 && domain_start(&dom, sim_nprocs, world_w, 2 * (n / sim_nprocs) + 4096, W * H, sim_numa)) {
+        n = n / sim_nprocs + (dom.rank < n % sim_nprocs);
+        if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        threads = threads / sim_nprocs > 1 ? threads / sim_nprocs : 1;
+        if (dom.rank == 0) atexit(stop_domain);
+    } else {
+        sim_nprocs = 1;
+    }
+    rng_seed(&rng, (sim_seed_value ? sim_seed_value : (uint64_t)time(NULL)) + (uint64_t)dom.rank);
+    kern_level = cpu_level();
+    kernels_select(&kern, kern_level);
+    int render = 0;
+    if (sim_nrender && sim_nprocs == 1) {
+        if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        render = sim_nrender > 0 ? sim_nrender : threads / 3 > 1 ? threads / 3 : 1;
+        threads = threads - render > 1 ? threads - render : 1;
+    }
+    jobs_init(threads);
+    if (render) render_pool = jobs_add_pool(render);
+    particles_init(&ps, n);
+    spawn_batch(0, n, NULL);
+    float cutoff = fmaxf(REPEL_CUTOFF, 2.0f * R_MAX);
+    grid_init(&grid, world_w, world_h, cutoff);
+    if (!schedule.nsys) sim_set_systems(NULL);
+    if (dom.rank > 0) serve();
+}
+
+// Morton reordering keeps particles that are close in space close in
+// memory, so the pair loops mostly hit cache. Re-sort every REORDER_EVERY
+// steps, or sooner once the sampled locality falls below REORDER_KEEP of
+// what it was right after the last sort: how local a sorted table can get
+// depends on the density, so sparse scenes would never pass a fixed bar.
+// Tables under REORDER_MIN_N particles sit in cache whatever their order
+// and are only re-sorted on the clock.
+#define REORDER_EVERY 240
+#define REORDER_CHECK 15
+#define REORDER_KEEP 0.6f
+#define REORDER_MIN_N 16384
+#define LOCALITY_DIST 64.0f
+
+static int since_reorder = REORDER_EVERY;
+static float sorted_locality;   // right after the last sort; 0 before one
+static long reorders;
+static long steps_taken, substeps_taken;
+
+static float locality(void) {
+    return storage == SIM_COMPACT ? compact_locality(&cps, ps.n, LOCALITY_DIST)
+                                  : particles_locality(&ps, LOCALITY_DIST);
+}
+
+static void sys_reorder(void) {
+    since_reorder++;
+    if (since_reorder < REORDER_EVERY && (since_reorder % REORDER_CHECK || ps.n < REORDER_MIN_N)) return;
+
+    // Compact runs keep no float positions: check locality on the compact
+    // ones and unpack only to sort
+    if (since_reorder < REORDER_EVERY && locality() >= REORDER_KEEP * sorted_locality) return;
+
+    if (storage == SIM_COMPACT) compact_unpack(&cps, &ps, 0, ps.n);
+    particles_sort_morton(&ps, world_w, world_h);
+    if (storage != SIM_FLOAT) compact_permute(&cps, (const int *)ps.tmp, ps.n);
+    sorted_locality = locality();
+    grid_n = -1;
+    since_reorder = 0;
+    reorders++;
+}
+
+void sim_get_stats(SimStats *s) {
+    s->reorders = reorders;
+    s->steps = steps_taken;
+    s->substeps = substeps_taken;
+    s->procs = dom.nprocs > 1 ? dom.nprocs : 1;
+    s->dropped = dropped;
+    memset(s->bin_count, 0, sizeof(s->bin_count));
+    for (int i = 0; i < ps.n; i++) s->bin_count[bins > 1 ? (int)ps.c[BIN][i] : 0]++;
 }
 
 // Step the simulation one frame
 void sim_step(float dt) {
     // tweakable constants (students can play here)
-    const float g    = 9.8f * 30.0f;   // pixels/sec^2
     const float e    = 0.95f;          // bounce restitution
+    const float G    = 50.0f;          // long-range attraction of the field system (negative repels)
+
+    if (dom.nprocs > 1 && dom.rank == 0) {
+        DomainCmd c = {DOMAIN_STEP, dt, 0, 0, 0, 0, 0, 0, 0};
+        domain_post_cmd(&dom, &c);
+    }
+
+    step.dt = dt;
+    step.inv_dt = 1.0f / dt;
+    step.e = e;
+    step.G = G;
+    step.strength = 0x3000;
+    step.tick = (uint32_t)steps_taken;
+
+    if (dom.nprocs > 1) migrate();
+    sys_reorder();
+    if (dom.nprocs > 1) add_ghosts();
+
+    // remember+integrate+bounce fused, then the grid, then repel (the
+    // tree and field after them when selected), each pooled pass with the
+    // whole pool to itself. Multi-rate steps skip the
+    // sub-steps where no bin is due.
+    int nsub = 1 << (bins - 1);
+    atomic_store(&step.maxbin, 0);
+    for (step.sub = 0; step.sub < nsub; step.sub += nsub >> atomic_load(&step.maxbin)) {
+        sched_run(&schedule, ps.n, CHUNK);
+        substeps_taken++;
+    }
+    if (dom.nprocs > 1) drop_ghosts();
+    step.sub = 0;
+    steps_taken++;
+}
+
+// ---- Snapshots ----
+// A snapshot holds everything the next step depends on, so the original run
+// and any replay from the snapshot stay bit-identical.
+// With compact storage the unpacked compact state is what gets saved (and in
+// SIM_COMPACT_CHECK that resets the float reference to it).
+
+static SnapRing ring;
+
+static void fill_header(SnapHeader *h, long frame) {
+    if (storage != SIM_FLOAT) compact_unpack(&cps, &ps, 0, ps.n);
+    memset(h, 0, sizeof(*h));
+    h->world_w = (uint32_t)world_w;
+    h->world_h = (uint32_t)world_h;
+    memcpy(h->rng, rng.s, sizeof(h->rng));
+    h->since_reorder = since_reorder;
+    h->sorted_locality = sorted_locality;
+    h->simd = (uint32_t)kern_level;
+    h->step = (uint64_t)steps_taken;
+    h->frame = (uint64_t)frame;
+}
 
-    sys_integrate(dt);
-    sys_bounce(e);
-    sys_repel(0x3000);
+static int restore_header(const SnapHeader *h, long *frame) {
+    memcpy(rng.s, h->rng, sizeof(rng.s));
+    since_reorder = h->since_reorder;
+    sorted_locality = h->sorted_locality;
+    steps_taken = (long)h->step;
+    if (frame) *frame = (long)h->frame;
+    grid_n = -1;
+    if (storage != SIM_FLOAT) {
+        if (!compact_reserve(&cps, ps.cap, 0)) return 0;
+        compact_pack(&cps, &ps, 0, ps.n);
+    }
+    return 1;
 }
 
-static void put_particle(uint32_t *fb, float x, float y, float r, uint32_t c) {
-    float r2 = r * r;
-    for (int px = -(r + 1.0f); px < r + 1.0f; px++) {
-        unsigned x2 = px * px;
-        for (int py = -(r + 1.0f); py < r + 1.0f; py++) {
-            unsigned d2 = x2 + py * py;
-            int fx = x + px, fy = y + py;
-            if (d2 < r2 && fx >= 0 && fx < W && fy >= 0 && fy < H)
-                fb[fx + fy * W] = c;
+long sim_steps(void) {
+    return steps_taken;
+}
+
+int sim_save(const char *path, long frame) {
+    if (dom.nprocs > 1) return 0;
+    SnapHeader h;
+    fill_header(&h, frame);
+    return snap_write(path, &h, &ps);
+}
+
+static int load_exact = 1;
+
+int sim_load(const char *path, long *frame) {
+    if (dom.nprocs > 1) return 0;
+    // Decode into a scratch store so a bad file leaves the sim untouched
+    Particles tmp;
+    SnapHeader h;
+    if (!particles_init(&tmp, 1)) return 0;
+    if (!snap_read(path, &h, &tmp) || h.world_w != (uint32_t)world_w || h.world_h != (uint32_t)world_h) {
+        particles_free(&tmp);
+        return 0;
+    }
+    particles_free(&ps);
+    ps = tmp;
+    load_exact = h.simd == (uint32_t)kern_level;
+    return restore_header(&h, frame);
+}
+
+int sim_load_exact(void) {
+    return load_exact;
+}
+
+void sim_checkpoint(long frame) {
+    if (dom.nprocs > 1) return;
+    SnapHeader h;
+    fill_header(&h, frame);
+    snap_ring_push(&ring, &h, &ps);
+}
+
+int sim_rewind(long step, long *frame) {
+    if (dom.nprocs > 1) return 0;
+    if (step < 0) step = 0;
+    size_t size;
+    const void *blob = snap_ring_find(&ring, (uint64_t)step, &size);
+    SnapHeader h;
+    if (!blob || !snap_decode(blob, size, &h, &ps)) return 0;
+    return restore_header(&h, frame);
+}
+
+// ---- Rendering ----
+// World to framebuffer: sx = x * zoom + ox, sy = oy - y * zoom (y points up
+// in the world, down in the framebuffer)
+static struct { float cx, cy, zoom; } view;
+
+typedef struct {
+    float zoom, ox, oy;
+    float x0, y0, x1, y1;   // world rectangle in view
+} Camera;
+
+void sim_set_view(float cx, float cy, float zoom) {
+    view.cx = cx;
+    view.cy = cy;
+    view.zoom = zoom;
+}
+
+static Camera camera(void) {
+    Camera c;
+    float cx = view.cx, cy = view.cy;
+    c.zoom = view.zoom;
+    if (c.zoom <= 0.0f) {
+        c.zoom = fminf(W / world_w, H / world_h);
+        cx = 0.5f * world_w;
+        cy = 0.5f * world_h;
+    }
+    c.ox = 0.5f * W - cx * c.zoom;
+    c.oy = 0.5f * H + cy * c.zoom - 1.0f;
+    c.x0 = -c.ox / c.zoom;
+    c.x1 = (W - c.ox) / c.zoom;
+    c.y0 = (c.oy - H) / c.zoom;
+    c.y1 = c.oy / c.zoom;
+    return c;
+}
+
+// Which pixels a disc covers depends only on k = ceil(r^2): the pixel dx, dy
+// away from the one under its centre is in when dx^2 + dy^2 < k. So a disc
+// is a run of rows, each a run of pixels isqrt(k - 1 - dy^2) either side of
+// the centre; rows for discs up to SPAN_R pixels come from a table.
+#define SPAN_R 32
+#define SPAN_K (SPAN_R * SPAN_R)
+
+static uint8_t span_half[SPAN_K + 1][SPAN_R];   // [k][|dy|]; [k][0] is the last row
+static int spans_ready;
+
+static int isqrt(int v) {
+    int s = (int)sqrtf((float)v);
+    while (s * s > v) s--;
+    while ((s + 1) * (s + 1) <= v) s++;
+    return s;
+}
+
+static void spans_init(void) {
+    if (spans_ready) return;
+    for (int k = 1; k <= SPAN_K; k++)
+        for (int dy = 0; dy * dy <= k - 1; dy++) span_half[k][dy] = (uint8_t)isqrt(k - 1 - dy * dy);
+    spans_ready = 1;
+}
+
+// Draw a disc, clipped to [x0, x1) x [y0, y1): rows are clipped once and
+// each becomes one run of stores
+static void put_particle(uint32_t *fb, int pitch, const Disc *d, int x0, int y0, int x1, int y1) {
+    int k = (int)ceilf(d->r * d->r);
+    if (k < 1) return;
+    const uint8_t *half = k <= SPAN_K ? span_half[k] : NULL;
+    int cx = (int)floorf(d->x), cy = (int)floorf(d->y), h = half ? half[0] : isqrt(k - 1);
+    int dy0 = y0 - cy > -h ? y0 - cy : -h, dy1 = y1 - 1 - cy < h ? y1 - 1 - cy : h;
+    for (int dy = dy0; dy <= dy1; dy++) {
+        int ady = dy < 0 ? -dy : dy;
+        int w = half ? half[ady] : isqrt(k - 1 - ady * ady);
+        int a = cx - w > x0 ? cx - w : x0, b = cx + w < x1 - 1 ? cx + w : x1 - 1;
+        uint32_t *row = fb + (size_t)(cy + dy) * pitch;
+        for (int fx = a; fx <= b; fx++) row[fx] = d->color;
+    }
+}
+
+// Channel order of the framebuffer
+static int pixel_layout = SIM_PIXELS_XRGB;
+
+static inline uint32_t pixel(uint32_t c) {
+    return pixel_layout == SIM_PIXELS_XBGR ? swap_rb(c) : c;
+}
+
+// World disc to framebuffer; r < 0 if none of it is on screen
+static inline Disc to_screen(const Camera *c, float x, float y, float r, uint32_t color) {
+    Disc d = {x * c->zoom + c->ox, c->oy - y * c->zoom, r * c->zoom, pixel(color)};
+    if (d.x + d.r < 0.0f || d.x - d.r >= W || d.y + d.r < 0.0f || d.y - d.r >= H) d.r = -1.0f;
+    return d;
+}
+
+// Blend from the previous to the current position; a jump of more than half
+// the world means the particle wrapped, so draw it where it is now
+static inline float lerp_pos(float prev, float cur, float alpha, float size) {
+    float d = cur - prev;
+    return fabsf(d) > 0.5f * size ? cur : prev + d * alpha;
+}
+
+// What a frame is drawn from: the live particles, or a copy published for
+// another thread (see sim_publish)
+typedef struct {
+    const Particles *ps;    // float storage
+    const Compact *cps;     // compact storage, when ps is NULL
+    int n;
+    const Grid *grid;       // index of the current slots, or NULL
+} Scene;
+
+static Scene live_scene(void) {
+    int fl = storage == SIM_FLOAT;
+    return (Scene){fl ? &ps : NULL, fl ? NULL : &cps, ps.n, fl && grid_n == ps.n ? &grid : NULL};
+}
+
+static Disc disc_of(const Scene *s, const Camera *c, int i, float alpha) {
+    if (!s->ps) {
+        const Compact *q = s->cps;
+        float x = lerp_pos(cpos_unpack(q->px[i]), cpos_unpack(q->x[i]), alpha, world_w);
+        float y = lerp_pos(cpos_unpack(q->py[i]), cpos_unpack(q->y[i]), alpha, world_h);
+        return to_screen(c, x, y, crad_unpack(q->r[i]), compact_color(q->col[i]));
+    }
+    float *const *particles = s->ps->c;
+    float x = lerp_pos(particles[PX][i], particles[X][i], alpha, world_w);
+    float y = lerp_pos(particles[PY][i], particles[Y][i], alpha, world_h);
+    return to_screen(c, x, y, particles[R][i], s->ps->color[i]);
+}
+
+// The grid from the last step doubles as the render index while its cells
+// still name the current slots. Discs are drawn between their last and
+// current positions, up to a step's motion (rarely more than DRAW_LAG) from
+// the cell they are in, so cells within VIEW_MARGIN of the view are drawn too.
+#define DRAW_LAG 48.0f
+#define VIEW_MARGIN (R_MAX + DRAW_LAG)
+#define TRAIL_FADE 0.75f        // disc mode: each frame keeps this much of the last
+
+static void view_cells(const Grid *g, const Camera *c, int *cx0, int *cx1, int *cy0, int *cy1) {
+    *cx0 = grid_col(g, c->x0 - VIEW_MARGIN);
+    *cx1 = grid_col(g, c->x1 + VIEW_MARGIN);
+    *cy0 = grid_row(g, c->y0 - VIEW_MARGIN);
+    *cy1 = grid_row(g, c->y1 + VIEW_MARGIN);
+}
+
+// ---- Tiled discs ----
+// Discs are drawn in parallel passes: every particle in view gets its
+// screen disc, the discs are binned to tiles (tiles.h), the last frame is
+// faded row by row (in place, or from another buffer holding it), and each
+// tile's discs are drawn by whichever worker takes it, which then copies the
+// finished tile to the write-only output, if any, while it is in cache.
+// Tiles share no pixels and keep the draw order, so the frame is the one a
+// single thread would draw.
+static Tiles tiles;
+static Disc *discs;
+static int discs_cap;
+static int *row_disc;       // grid rows in view: index of each one's first disc
+static int row_disc_cap;
+
+typedef struct {
+    Camera c;
+    float alpha;
+    uint32_t *fb;
+    int pitch;              // pixels from one framebuffer row to the next
+    const uint32_t *trail;  // the last frame, to fade into fb: fb itself, another buffer, or NULL for black
+    int trail_pitch;
+    uint32_t *out;          // written a copy of the frame and never read (locked texture memory), or NULL
+    int out_pitch;
+    int cx0, cx1, cy0;      // cells in view, when drawing from the grid
+    const Scene *s;
+} RenderPass;
+
+// Lazy fade. idle[t] counts the frames since anything was drawn in tile t
+// of a framebuffer, up to fade_frames, after which every pixel there is 0
+// and the tile can be left alone until something lands in it. 0 is always
+// safe: it only means "fade it".
+#define LAZY_FBS 4
+#define NTILES (((W + TILE - 1) / TILE) * ((H + TILE - 1) / TILE))
+
+static int fade_mode = SIM_FADE_FULL;
+static int fade_frames;     // fades that take 255 to 0; more than any count when it never gets there
+static long lazy_clock;
+static struct {
+    const uint32_t *fb;
+    long used;              // lazy_clock at its last frame, to pick one to evict
+    int idle[NTILES];
+} lazy[LAZY_FBS];
+static uint8_t tile_fades[NTILES];  // this frame: whether each tile is faded
+
+void sim_set_fade(int mode) {
+    fade_mode = mode;
+    for (int s = 0; s < LAZY_FBS; s++) lazy[s].fb = NULL;
+}
+
+static int lazy_find(const uint32_t *fb) {
+    for (int s = 0; s < LAZY_FBS; s++)
+        if (lazy[s].fb == fb) return s;
+    return -1;
+}
+
+// Tile counts for fb, starting over for one not seen lately
+static int *lazy_idle(const uint32_t *fb) {
+    if (!fade_frames) {
+        uint32_t k = fade_factor(TRAIL_FADE), c = 255;
+        for (fade_frames = 0; c && fade_frames < 256; fade_frames++) c = c * k >> 8;
+        if (c) fade_frames = INT_MAX;
+    }
+    int s = lazy_find(fb);
+    if (s < 0) {
+        s = 0;
+        for (int k = 1; k < LAZY_FBS; k++)
+            if (lazy[k].used < lazy[s].used) s = k;
+        lazy[s].fb = fb;
+        memset(lazy[s].idle, 0, sizeof(lazy[s].idle));
+    }
+    lazy[s].used = ++lazy_clock;
+    return lazy[s].idle;
+}
+
+// fb was written some other way; every tile may hold anything
+static void lazy_forget(const uint32_t *fb) {
+    int s = lazy_find(fb);
+    if (s >= 0) memset(lazy[s].idle, 0, sizeof(lazy[s].idle));
+}
+
+void sim_render_touched(const uint32_t *fb, int x0, int y0, int x1, int y1) {
+    int s = lazy_find(fb);
+    if (s < 0 || !tiles.start) return;
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 < W ? x1 : W;
+    y1 = y1 < H ? y1 : H;
+    for (int ty = y0 / TILE; ty * TILE < y1; ty++)
+        for (int tx = x0 / TILE; tx * TILE < x1; tx++) lazy[s].idle[tx + ty * tiles.cols] = 0;
+}
+
+static int discs_reserve(int n, int rows) {
+    if (!tiles.start && !tiles_init(&tiles, W, H)) return 0;
+    spans_init();
+    if (n > discs_cap) {
+        Disc *d = realloc(discs, (size_t)n * sizeof(Disc));
+        if (!d) return 0;
+        discs = d;
+        discs_cap = n;
+    }
+    if (rows + 1 > row_disc_cap) {
+        int *r = realloc(row_disc, (size_t)(rows + 1) * sizeof(int));
+        if (!r) return 0;
+        row_disc = r;
+        row_disc_cap = rows + 1;
+    }
+    return 1;
+}
+
+static void disc_slots(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    const RenderPass *p = arg;
+    for (int i = lo; i < hi; i++) discs[i] = disc_of(p->s, &p->c, i, p->alpha);
+}
+
+// Grid rows cy0 + [lo, hi)
+static void disc_cells(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    const RenderPass *p = arg;
+    const Grid *g = p->s->grid;
+    for (int row = lo; row < hi; row++) {
+        int cy = p->cy0 + row, a = g->start[p->cx0 + cy * g->cols], end = g->start[p->cx1 + 1 + cy * g->cols];
+        for (Disc *d = discs + row_disc[row]; a < end; a++) *d++ = disc_of(p->s, &p->c, g->items[a], p->alpha);
+    }
+}
+
+static void count_chunks(void *arg, int lo, int hi, int worker) {
+    (void)arg; (void)worker;
+    for (int k = lo; k < hi; k++) tiles_count(&tiles, discs, k);
+}
+
+static void fill_chunks(void *arg, int lo, int hi, int worker) {
+    (void)arg; (void)worker;
+    for (int k = lo; k < hi; k++) tiles_fill(&tiles, discs, k);
+}
+
+// Lazily, only tiles that may still hold a trail are faded; ones black in
+// both the trail and fb are drawn into as they are. fb's counts carry on
+// from the trail's frame (a trail not tracked may hold anything).
+static void plan_fade(const uint32_t *fb, const uint32_t *trail) {
+    int *idle = fade_mode == SIM_FADE_LAZY ? lazy_idle(fb) : NULL;
+    int s = trail && trail != fb ? lazy_find(trail) : -1;
+    for (int t = 0; t < NTILES; t++) {
+        if (!idle) {
+            tile_fades[t] = 1;
+            continue;
+        }
+        int from = trail == fb ? idle[t] : !trail ? fade_frames : s >= 0 ? lazy[s].idle[t] : 0;
+        tile_fades[t] = from < fade_frames || idle[t] < fade_frames;
+        if (tiles.start[t + 1] > tiles.start[t]) idle[t] = 0;
+        else idle[t] = from < fade_frames ? from + 1 : from;
+    }
+}
+
+// Pixels [x0, x1) of row y: the trail's, faded, or black without one
+static void fade_span(const RenderPass *p, int y, int x0, int x1) {
+    uint32_t *dst = p->fb + x0 + (size_t)y * p->pitch;
+    if (p->trail) kern.fade(dst, p->trail + x0 + (size_t)y * p->trail_pitch, x1 - x0, fade_factor(TRAIL_FADE));
+    else memset(dst, 0, (size_t)(x1 - x0) * sizeof(uint32_t));
+}
+
+// Framebuffer rows [lo, hi), each in runs of neighbouring tiles to fade:
+// the whole row when every tile is, so memory is walked in order
+static void fade_rows(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    const RenderPass *p = arg;
+    for (int y = lo; y < hi; y++) {
+        const uint8_t *f = tile_fades + y / TILE * tiles.cols;
+        for (int tx = 0; tx < tiles.cols; tx++) {
+            if (!f[tx]) continue;
+            int end = tx;
+            while (end + 1 < tiles.cols && f[end + 1]) end++;
+            fade_span(p, y, tx * TILE, (end + 1) * TILE < W ? (end + 1) * TILE : W);
+            tx = end;
+        }
+    }
+}
+
+// [x0, x1) of rows [y0, y1) of the finished frame to out; black ones are
+// written without reading fb
+static void put_out(const RenderPass *p, int x0, int y0, int x1, int y1, int black) {
+    for (int y = y0; y < y1; y++) {
+        uint32_t *dst = p->out + x0 + (size_t)y * p->out_pitch;
+        if (black) memset(dst, 0, (size_t)(x1 - x0) * sizeof(uint32_t));
+        else memcpy(dst, p->fb + x0 + (size_t)y * p->pitch, (size_t)(x1 - x0) * sizeof(uint32_t));
+    }
+}
+
+static void draw_tiles(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    const RenderPass *p = arg;
+    for (int t = lo; t < hi; t++) {
+        int x0, y0, x1, y1;
+        tiles_rect(&tiles, t, &x0, &y0, &x1, &y1);
+        for (int a = tiles.start[t]; a < tiles.start[t + 1]; a++)
+            put_particle(p->fb, p->pitch, &discs[tiles.items[a]], x0, y0, x1, y1);
+        // A tile left unfaded and without discs is black (see plan_fade)
+        if (p->out) put_out(p, x0, y0, x1, y1, !tile_fades[t] && tiles.start[t + 1] == tiles.start[t]);
+    }
+}
+
+static int bin_discs(int n) {
+    if (!tiles_begin(&tiles, n)) return 0;
+    jobs_parallel_for(tiles.chunks, 1, count_chunks, NULL);
+    if (!tiles_offsets(&tiles)) return 0;
+    jobs_parallel_for(tiles.chunks, 1, fill_chunks, NULL);
+    return 1;
+}
+
+// Discs come from the grid cells in view while it indexes the current
+// slots (float storage), otherwise from every slot. Returns 0, with fb
+// untouched, if the bins cannot be allocated.
+static int render_discs(const RenderPass *in) {
+    RenderPass p = *in;
+    const Scene *s = p.s;
+    const Camera *c = &p.c;
+    uint32_t *fb = p.fb;
+    const Grid *g = s->grid;
+    int rows = 0, cy1;
+    if (g) {
+        view_cells(g, c, &p.cx0, &p.cx1, &p.cy0, &cy1);
+        rows = cy1 - p.cy0 + 1;
+    }
+    if (!discs_reserve(s->n, rows)) return 0;
+    int n = s->n;
+    if (g) {
+        row_disc[0] = 0;
+        for (int row = 0; row < rows; row++) {
+            int cy = p.cy0 + row;
+            row_disc[row + 1] = row_disc[row] + g->start[p.cx1 + 1 + cy * g->cols] - g->start[p.cx0 + cy * g->cols];
+        }
+        n = row_disc[rows];
+        jobs_parallel_for(rows, 1, disc_cells, &p);
+    } else {
+        jobs_parallel_for(n, CHUNK, disc_slots, &p);
+    }
+    if (!bin_discs(n)) return 0;
+    plan_fade(fb, p.trail);
+    jobs_parallel_for(H, 16, fade_rows, &p);
+    jobs_parallel_for(tiles.cols * tiles.rows, 1, draw_tiles, &p);
+    return 1;
+}
+
+// ---- Density splats ----
+// Each particle adds 1 to the count of the pixel under its centre and its
+// speed to that pixel's speed sum; one pass then maps the count to
+// brightness and the mean speed to hue. The adds are integer atomics, which
+// commute, so the picture does not depend on the thread count.
+#define SPEED_SCALE    4.0f     // speed sums count 1/4 px/s
+#define SPEED_CLAMP    1023.0f  // px/s, so a sum overflows only past ~1M particles in a pixel
+#define SPEED_HOT      600.0f   // px/s at the hot end of the ramp
+#define SPEED_BANDS    32
+#define DENSITY_LEVELS 64
+#define DENSITY_FULL   256      // particles in a pixel for full brightness
+
+static int render_mode = SIM_RENDER_AUTO;
+static _Atomic uint32_t *dens_count, *dens_speed;
+static uint8_t level_of[DENSITY_FULL + 1];
+static uint32_t tone[SPEED_BANDS][DENSITY_LEVELS];
+
+void sim_set_render(int mode) {
+    render_mode = mode;
+}
+
+static int taken_n = -1;            // particles in the last published scene taken
+
+static int mode_for(int n) {
+    if (render_mode != SIM_RENDER_AUTO) return render_mode;
+    return n > SIM_DENSITY_AUTO_N ? SIM_RENDER_DENSITY : SIM_RENDER_DISCS;
+}
+
+int sim_render_mode(void) {
+    return mode_for(taken_n >= 0 ? taken_n : sim_count());
+}
+
+static void tone_init(void);
+
+// Blue when slow, through white, to orange when fast; brightness grows with
+// the log of the count, from a quarter at one particle
+static int density_init(void) {
+    if (dens_count) return 1;
+    dens_count = calloc((size_t)W * H, sizeof(*dens_count));
+    dens_speed = calloc((size_t)W * H, sizeof(*dens_speed));
+    if (!dens_count || !dens_speed) {
+        free(dens_count); free(dens_speed);
+        dens_count = dens_speed = NULL;
+        return 0;
+    }
+    for (int n = 1; n <= DENSITY_FULL; n++)
+        level_of[n] = (uint8_t)((DENSITY_LEVELS - 1) * logf((float)n) / logf((float)DENSITY_FULL) + 0.5f);
+    tone_init();
+    return 1;
+}
+
+static void tone_init(void) {
+    static const float stops[3][3] = {{60, 120, 255}, {255, 255, 255}, {255, 140, 30}};
+    for (int b = 0; b < SPEED_BANDS; b++) {
+        float t = 2.0f * b / (SPEED_BANDS - 1);
+        int k = t < 1.0f ? 0 : 1;
+        float f = t - k;
+        for (int l = 0; l < DENSITY_LEVELS; l++) {
+            float g = 0.25f + 0.75f * l / (DENSITY_LEVELS - 1);
+            uint8_t ch[3];
+            for (int j = 0; j < 3; j++) ch[j] = (uint8_t)(g * (stops[k][j] + f * (stops[k + 1][j] - stops[k][j])));
+            tone[b][l] = pixel(rgb(ch[0], ch[1], ch[2]));
         }
     }
 }
 
-// Render the simulation into framebuffer
-void sim_render(uint32_t *fb) {
-    for (int i = 0; i < W * H; i++) fb[i] = fade(fb[i], 0.75);
-    for (int i = 0; i < N; i++)
-        put_particle(fb, particles[X][i], H - particles[Y][i] - 1, particles[R][i], color[i]);
-}
\ No newline at end of file
+static inline void splat(const Camera *c, float x, float y, float vx, float vy) {
+    float sx = x * c->zoom + c->ox, sy = c->oy - y * c->zoom;
+    if (!(sx >= 0.0f && sx < W && sy >= 0.0f && sy < H)) return;
+    int p = (int)sx + (int)sy * W;
+    float v = fminf(sqrtf(vx * vx + vy * vy), SPEED_CLAMP);
+    atomic_fetch_add_explicit(&dens_count[p], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&dens_speed[p], (uint32_t)(v * SPEED_SCALE), memory_order_relaxed);
+}
+
+static inline void splat_float(const RenderPass *s, int i) {
+    float *const *particles = s->s->ps->c;
+    float x = lerp_pos(particles[PX][i], particles[X][i], s->alpha, world_w);
+    float y = lerp_pos(particles[PY][i], particles[Y][i], s->alpha, world_h);
+    splat(&s->c, x, y, particles[VX][i], particles[VY][i]);
+}
+
+static void splat_slots(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    const RenderPass *s = arg;
+    if (s->s->ps) {
+        for (int i = lo; i < hi; i++) splat_float(s, i);
+        return;
+    }
+    const Compact *q = s->s->cps;
+    for (int i = lo; i < hi; i++) {
+        float x = lerp_pos(cpos_unpack(q->px[i]), cpos_unpack(q->x[i]), s->alpha, world_w);
+        float y = lerp_pos(cpos_unpack(q->py[i]), cpos_unpack(q->y[i]), s->alpha, world_h);
+        splat(&s->c, x, y, half_unpack(q->vx[i]), half_unpack(q->vy[i]));
+    }
+}
+
+// Grid rows cy0 + [lo, hi)
+static void splat_cells(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    const RenderPass *s = arg;
+    const Grid *g = s->s->grid;
+    for (int cy = s->cy0 + lo; cy < s->cy0 + hi; cy++) {
+        for (int cx = s->cx0; cx <= s->cx1; cx++) {
+            int cell = cx + cy * g->cols;
+            for (int a = g->start[cell]; a < g->start[cell + 1]; a++) splat_float(s, g->items[a]);
+        }
+    }
+}
+
+// Framebuffer rows [lo, hi): colour each pixel and clear it for the next
+// frame, then copy the row out
+static void tone_rows(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    const RenderPass *s = arg;
+    for (int y = lo; y < hi; y++) {
+        uint32_t *out = s->fb + (size_t)y * s->pitch;
+        _Atomic uint32_t *count = dens_count + (size_t)y * W, *speed = dens_speed + (size_t)y * W;
+        for (int x = 0; x < W; x++) {
+            uint32_t n = atomic_load_explicit(&count[x], memory_order_relaxed);
+            if (!n) {
+                out[x] = 0;
+                continue;
+            }
+            uint32_t sum = atomic_load_explicit(&speed[x], memory_order_relaxed);
+            float mean = (float)sum / ((float)n * SPEED_SCALE);
+            int band = (int)(mean * ((SPEED_BANDS - 1) / SPEED_HOT));
+            band = band < SPEED_BANDS - 1 ? band : SPEED_BANDS - 1;
+            out[x] = tone[band][level_of[n < DENSITY_FULL ? n : DENSITY_FULL]];
+            atomic_store_explicit(&count[x], 0, memory_order_relaxed);
+            atomic_store_explicit(&speed[x], 0, memory_order_relaxed);
+        }
+        if (s->out) put_out(s, 0, y, W, y + 1, 0);
+    }
+}
+
+static void render_density(const RenderPass *p) {
+    RenderPass s = *p;
+    const Scene *sc = s.s;
+    if (sc->grid) {
+        int cy1;
+        view_cells(sc->grid, &s.c, &s.cx0, &s.cx1, &s.cy0, &cy1);
+        jobs_parallel_for(cy1 - s.cy0 + 1, 1, splat_cells, &s);
+    } else {
+        jobs_parallel_for(sc->n, CHUNK, splat_slots, &s);
+    }
+    jobs_parallel_for(H, 16, tone_rows, &s);
+}
+
+// Draw s into p.fb over the last frame, p.trail, and out to p.out (see
+// RenderPass)
+static void render_local(RenderPass p, const Scene *s, float alpha) {
+    p.c = camera();
+    p.alpha = alpha;
+    p.s = s;
+    if (mode_for(s->n) == SIM_RENDER_DENSITY && density_init()) {
+        render_density(&p);
+        lazy_forget(p.fb);
+        return;
+    }
+    if (!render_discs(&p)) {
+        for (int y = 0; y < H; y++) fade_span(&p, y, 0, W);
+        if (p.out) put_out(&p, 0, 0, W, H, 0);
+        lazy_forget(p.fb);
+    }
+}
+
+static void composite_rows(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    const RenderPass *p = arg;
+    for (int y = lo; y < hi; y++) {
+        domain_composite(&dom, p->fb + (size_t)y * p->pitch, y * W, (y + 1) * W);
+        if (p->out) put_out(p, 0, y, W, y + 1, 0);
+    }
+}
+
+void sim_set_pixels(int layout) {
+    pixel_layout = layout;
+    if (dens_count) tone_init();
+}
+
+// Render the simulation into framebuffer, alpha of the way from the
+// previous step to the current one. With several processes every rank
+// draws its own particles into its shared framebuffer, trails and all,
+// and rank 0 merges them.
+void sim_render(uint32_t *fb, float alpha) {
+    sim_render_out(fb, NULL, 0, alpha);
+}
+
+void sim_render_out(uint32_t *fb, uint32_t *out, int out_pitch, float alpha) {
+    Scene s = live_scene();
+    RenderPass p = {.fb = fb, .pitch = W, .trail = fb, .trail_pitch = W, .out = out, .out_pitch = out_pitch};
+    if (dom.nprocs <= 1) {
+        render_local(p, &s, alpha);
+        return;
+    }
+    DomainCmd c = {DOMAIN_RENDER, 0, alpha, view.cx, view.cy, view.zoom, sim_render_mode(), fade_mode, pixel_layout};
+    domain_post_cmd(&dom, &c);
+    uint32_t *own = domain_framebuffer(&dom);
+    render_local((RenderPass){.fb = own, .pitch = W, .trail = own, .trail_pitch = W}, &s, alpha);
+    domain_sync(&dom);
+    jobs_parallel_for(H, 16, composite_rows, &p);
+}
+
+// ---- Published scenes ----
+// sim_publish copies what drawing reads into the back one of three scene
+// buffers and hands it over (handoff.h); sim_render_published takes the
+// newest and draws it while the next steps run. Only positions now and a
+// step back, radii, colours, velocities (for density hues) and the grid
+// index are copied. Each frame fades the last one over from the buffer it
+// went to, so frames can go to any of the caller's buffers without a copy.
+// With sim_set_render_threads the drawing runs on a worker pool of its own.
+typedef struct {
+    Particles ps;           // X, Y, PX, PY, VX, VY, R and colour only
+    Compact cps;
+    Grid grid;
+    Scene s;
+    float alpha;
+    double tag;
+} Published;
+
+static const int pub_comps[] = {X, Y, PX, PY, VX, VY, R};
+#define PUB_NCOMPS ((int)(sizeof(pub_comps) / sizeof(pub_comps[0])))
+
+static Published pub[3];
+static Handoff pub_slots = HANDOFF_INIT;
+static const uint32_t *last_frame;  // where the last published frame went
+
+static int pub_reserve(Published *p, int n, int cells) {
+    if (storage != SIM_FLOAT) return compact_reserve(&p->cps, n, 0);
+    if (n > p->ps.cap) {
+        for (int k = 0; k < PUB_NCOMPS; k++) {
+            float *a = realloc(p->ps.c[pub_comps[k]], (size_t)n * sizeof(float));
+            if (!a) return 0;
+            p->ps.c[pub_comps[k]] = a;
+        }
+        uint32_t *col = realloc(p->ps.color, (size_t)n * sizeof(uint32_t));
+        if (!col) return 0;
+        p->ps.color = col;
+        p->ps.cap = n;
+    }
+    if (!cells) return 1;
+    if (!p->grid.start && !(p->grid.start = malloc(((size_t)grid.cols * grid.rows + 1) * sizeof(int)))) return 0;
+    if (n > p->grid.cap) {
+        int *items = realloc(p->grid.items, (size_t)n * sizeof(int));
+        if (!items) return 0;
+        p->grid.items = items;
+        p->grid.cap = n;
+    }
+    return 1;
+}
+
+static void copy_slots(void *arg, int lo, int hi, int worker) {
+    (void)worker;
+    Published *p = arg;
+    size_t m = (size_t)(hi - lo);
+    if (p->s.ps) {
+        for (int k = 0; k < PUB_NCOMPS; k++)
+            memcpy(p->ps.c[pub_comps[k]] + lo, ps.c[pub_comps[k]] + lo, m * sizeof(float));
+        memcpy(p->ps.color + lo, ps.color + lo, m * sizeof(uint32_t));
+    } else {
+        memcpy(p->cps.x + lo, cps.x + lo, m * sizeof(uint16_t));
+        memcpy(p->cps.y + lo, cps.y + lo, m * sizeof(uint16_t));
+        memcpy(p->cps.px + lo, cps.px + lo, m * sizeof(uint16_t));
+        memcpy(p->cps.py + lo, cps.py + lo, m * sizeof(uint16_t));
+        memcpy(p->cps.vx + lo, cps.vx + lo, m * sizeof(uint16_t));
+        memcpy(p->cps.vy + lo, cps.vy + lo, m * sizeof(uint16_t));
+        memcpy(p->cps.r + lo, cps.r + lo, m);
+        memcpy(p->cps.col + lo, cps.col + lo, m);
+    }
+    if (p->s.grid) memcpy(p->grid.items + lo, grid.items + lo, m * sizeof(int));
+}
+
+int sim_publish(float alpha, double tag) {
+    if (dom.nprocs > 1) return 0;
+    Published *p = &pub[pub_slots.back];
+    int fl = storage == SIM_FLOAT, cells = fl && grid_n == ps.n;
+    if (!pub_reserve(p, ps.n, cells)) return 0;
+    p->s = (Scene){fl ? &p->ps : NULL, fl ? NULL : &p->cps, ps.n, cells ? &p->grid : NULL};
+    if (cells) {
+        int *start = p->grid.start, *items = p->grid.items, cap = p->grid.cap;
+        p->grid = grid;
+        p->grid.start = start;
+        p->grid.items = items;
+        p->grid.cell_of = NULL;
+        p->grid.cap = cap;
+        memcpy(start, grid.start, ((size_t)grid.cols * grid.rows + 1) * sizeof(int));
+    }
+    jobs_parallel_for(ps.n, CHUNK, copy_slots, p);
+    p->alpha = alpha;
+    p->tag = tag;
+    handoff_put(&pub_slots);
+    return 1;
+}
+
+int sim_published_pending(void) {
+    return handoff_pending(&pub_slots);
+}
+
+int sim_render_published(uint32_t *fb, uint32_t *out, int out_pitch, double *tag) {
+    if (!handoff_take(&pub_slots)) return 0;
+    const Published *p = &pub[pub_slots.front];
+    taken_n = p->s.n;
+    if (tag) *tag = p->tag;
+    int pool = jobs_use_pool(render_pool);
+    RenderPass r = {.fb = fb, .pitch = W, .trail = last_frame, .trail_pitch = W, .out = out, .out_pitch = out_pitch};
+    render_local(r, &p->s, p->alpha);
+    jobs_use_pool(pool);
+    last_frame = fb;
+    return 1;
+}
+
+// Ranks above 0 run the coordinator's commands until told to quit
+static void serve(void) {
+    for (DomainCmd c;;) {
+        domain_wait_cmd(&dom, &c);
+        if (c.cmd == DOMAIN_STEP) {
+            sim_step(c.dt);
+        } else if (c.cmd == DOMAIN_RENDER) {
+            sim_set_view(c.cx, c.cy, c.zoom);
+            render_mode = c.render_mode;
+            if (c.fade_mode != fade_mode) sim_set_fade(c.fade_mode);
+            if (c.pixels != pixel_layout) sim_set_pixels(c.pixels);
+            Scene s = live_scene();
+            uint32_t *own = domain_framebuffer(&dom);
+            render_local((RenderPass){.fb = own, .pitch = W, .trail = own, .trail_pitch = W}, &s, c.alpha);
+            domain_sync(&dom);
+        } else {
+            _exit(0);
+        }
+    }
+}
@@ -0,0 +1,97 @@
+// tiles.c
+#include "tiles.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+int tiles_init(Tiles *t, int w, int h) {
+    memset(t, 0, sizeof(*t));
+    t->w = w;
+    t->h = h;
+    t->cols = (w + TILE - 1) / TILE;
+    t->rows = (h + TILE - 1) / TILE;
+    t->start = calloc((size_t)t->cols * t->rows + 1, sizeof(int));
+    return t->start != NULL;
+}
+
+void tiles_free(Tiles *t) {
+    free(t->start);
+    free(t->items);
+    free(t->count);
+    memset(t, 0, sizeof(*t));
+}
+
+// Tiles under the disc's bounding box, padded a pixel for rounding; 0 if
+// it is off screen or not drawn
+static int tile_span(const Tiles *t, const Disc *d, int *tx0, int *ty0, int *tx1, int *ty1) {
+    if (d->r < 0.0f) return 0;
+    int x0 = (int)floorf(d->x - d->r) - 1, x1 = (int)floorf(d->x + d->r) + 1;
+    int y0 = (int)floorf(d->y - d->r) - 1, y1 = (int)floorf(d->y + d->r) + 1;
+    if (x1 < 0 || y1 < 0 || x0 >= t->w || y0 >= t->h) return 0;
+    *tx0 = x0 < 0 ? 0 : x0 / TILE;
+    *ty0 = y0 < 0 ? 0 : y0 / TILE;
+    *tx1 = x1 >= t->w ? t->cols - 1 : x1 / TILE;
+    *ty1 = y1 >= t->h ? t->rows - 1 : y1 / TILE;
+    return 1;
+}
+
+int tiles_begin(Tiles *t, int n) {
+    t->n = n;
+    t->chunk = (n + TILES_MAX_CHUNKS - 1) / TILES_MAX_CHUNKS;
+    if (t->chunk < TILES_CHUNK) t->chunk = TILES_CHUNK;
+    t->chunks = (n + t->chunk - 1) / t->chunk;
+    int need = t->chunks * t->cols * t->rows;
+    if (need > t->count_cap) {
+        int *count = realloc(t->count, (size_t)need * sizeof(int));
+        if (!count) return 0;
+        t->count = count;
+        t->count_cap = need;
+    }
+    return 1;
+}
+
+void tiles_count(Tiles *t, const Disc *d, int chunk) {
+    int *count = t->count + (size_t)chunk * t->cols * t->rows;
+    memset(count, 0, (size_t)t->cols * t->rows * sizeof(int));
+    int lo = chunk * t->chunk, hi = lo + t->chunk < t->n ? lo + t->chunk : t->n;
+    for (int i = lo; i < hi; i++) {
+        int tx0, ty0, tx1, ty1;
+        if (!tile_span(t, &d[i], &tx0, &ty0, &tx1, &ty1)) continue;
+        for (int ty = ty0; ty <= ty1; ty++)
+            for (int tx = tx0; tx <= tx1; tx++) count[tx + ty * t->cols]++;
+    }
+}
+
+// Lay the lists out tile by tile, and within a tile chunk by chunk, so each
+// list comes out in disc order; the counts become each chunk's write cursors
+int tiles_offsets(Tiles *t) {
+    int ntiles = t->cols * t->rows, sum = 0;
+    for (int k = 0; k < ntiles; k++) {
+        t->start[k] = sum;
+        for (int c = 0; c < t->chunks; c++) {
+            int *n = &t->count[(size_t)c * ntiles + k];
+            int m = *n;
+            *n = sum;
+            sum += m;
+        }
+    }
+    t->start[ntiles] = sum;
+    if (sum > t->cap) {
+        int *items = realloc(t->items, (size_t)sum * sizeof(int));
+        if (!items) return 0;
+        t->items = items;
+        t->cap = sum;
+    }
+    return 1;
+}
+
+void tiles_fill(Tiles *t, const Disc *d, int chunk) {
+    int *cursor = t->count + (size_t)chunk * t->cols * t->rows;
+    int lo = chunk * t->chunk, hi = lo + t->chunk < t->n ? lo + t->chunk : t->n;
+    for (int i = lo; i < hi; i++) {
+        int tx0, ty0, tx1, ty1;
+        if (!tile_span(t, &d[i], &tx0, &ty0, &tx1, &ty1)) continue;
+        for (int ty = ty0; ty <= ty1; ty++)
+            for (int tx = tx0; tx <= tx1; tx++) t->items[cursor[tx + ty * t->cols]++] = i;
+    }
+}
@@ -0,0 +1,56 @@
+// tiles.h
+#ifndef TILES_H
+#define TILES_H
+
+#include <stdint.h>
+
+// Screen-space bins for the renderer. The framebuffer is cut into
+// TILE x TILE tiles and every disc is listed under each tile its bounding
+// box touches. Lists keep the order discs were given in, so drawing each
+// tile's list in order, clipped to the tile, paints exactly what drawing
+// all discs in order would; tiles share no pixels, so they can be drawn by
+// different threads without locks.
+#define TILE 128
+#define TILES_CHUNK 4096        // fewest discs per counting chunk
+#define TILES_MAX_CHUNKS 256
+
+// A disc in framebuffer pixels; r < 0 marks one that is not drawn
+typedef struct {
+    float x, y, r;
+    uint32_t color;
+} Disc;
+
+typedef struct {
+    int w, h;               // framebuffer size
+    int cols, rows;
+    int *start;             // cols * rows + 1 offsets into items
+    int *items;             // disc indices grouped by tile
+    int cap;                // capacity of items
+    int n, chunk, chunks;   // discs being binned, split into chunks
+    int *count;             // [chunk][tile] counts, then write cursors
+    int count_cap;
+} Tiles;
+
+// Allocate bins for a w x h framebuffer; returns 0 on failure
+int  tiles_init(Tiles *t, int w, int h);
+void tiles_free(Tiles *t);
+
+// Binning is a counting sort in three steps, so the caller can spread the
+// first and last over threads: tiles_begin picks the chunking for n discs,
+// tiles_count and then tiles_fill run once for each chunk in [0, t->chunks)
+// (in any order, in parallel), with tiles_offsets between them. The
+// begin / offsets steps return 0 on allocation failure.
+int  tiles_begin(Tiles *t, int n);
+void tiles_count(Tiles *t, const Disc *d, int chunk);
+int  tiles_offsets(Tiles *t);
+void tiles_fill(Tiles *t, const Disc *d, int chunk);
+
+// Pixel rectangle [x0, x1) x [y0, y1) of a tile
+static inline void tiles_rect(const Tiles *t, int tile, int *x0, int *y0, int *x1, int *y1) {
+    *x0 = tile % t->cols * TILE;
+    *y0 = tile / t->cols * TILE;
+    *x1 = *x0 + TILE < t->w ? *x0 + TILE : t->w;
+    *y1 = *y0 + TILE < t->h ? *y0 + TILE : t->h;
+}
+
+#endif // TILES_H